@@ -0,0 +1,472 @@
+/***************************************************************************************
+ * Copyright (c) 2014 Robert Riemann <robert@riemann.cc>                                *
+ *                                                                                      *
+ * This program is free software; you can redistribute it and/or modify it under        *
+ * the terms of the GNU General Public License as published by the Free Software        *
+ * Foundation; either version 2 of the License, or (at your option) any later           *
+ * version.                                                                             *
+ *                                                                                      *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY      *
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A      *
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.             *
+ *                                                                                      *
+ * You should have received a copy of the GNU General Public License along with         *
+ * this program.  If not, see <http://www.gnu.org/licenses/>.                           *
+ ****************************************************************************************/
+
+#include <array>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <boost/format.hpp>
+
+#include "multires/multires_grid.hpp"
+#include "monores/monores_grid.hpp"
+
+#include "config.hpp"
+#include "functions.h"
+#include "perf.hpp"
+
+/*!
+   \brief The sample_t struct is one repetition of a benchmark
+ */
+struct sample_t {
+    double seconds; //!< duration of the repetition
+    size_t items;   //!< cells, leaves or nodes processed by the repetition
+    perf_values_t events; //!< hardware counters of all threads during the repetition, 0 if not counted
+};
+
+/*!
+   \brief The result_t struct summarises the repetitions of a benchmark
+ */
+struct result_t {
+    std::string name; //!< benchmark, e.g. `multires.updateFlow.x`
+    size_t level;     //!< finest level of the grid
+    real   epsilon;   //!< threshold of the grid, 0 for monores_grid_t
+    int    threads;   //!< number of OpenMP threads
+    size_t samples;   //!< number of repetitions
+    size_t items;     //!< items of the median repetition
+    double min;       //!< seconds per item of the fastest repetition
+    double median;    //!< seconds per item of the median repetition
+    std::array<double, perfCount> events; //!< hardware counters per item of the median repetition
+};
+
+/*!
+   \brief seconds measures the wall clock time of a call
+ */
+template<typename function_type>
+double seconds(function_type function)
+{
+    const auto start = std::chrono::steady_clock::now();
+    function();
+    const auto done = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::duration<double>>(done - start).count();
+}
+
+/*!
+   \brief The benchmark_t class measures the phases of the time steps and of the remesh
+
+   It is a friend of the grids, so the phases are called like the grids call
+   them. Every benchmark is repeated and summarised by the fastest and the
+   median repetition per item.
+ */
+class benchmark_t
+{
+public:
+    /*!
+       \brief benchmark_t
+       \param repeat number of repetitions of every benchmark
+       \param f_eval initializer of the grids
+     */
+    benchmark_t(const size_t repeat, const field_generator_t &f_eval) :
+        m_repeat(repeat)
+      , m_f_eval(f_eval)
+      , m_threads(1)
+      , m_counters(false)
+      , m_checksum(0)
+    {}
+
+    /*!
+       \brief setThreads sets the number of OpenMP threads of the following benchmarks
+     */
+    void setThreads(const int threads);
+
+    /*!
+       \brief setCounters reads the hardware counters of perf.hpp around every repetition
+       \return false if the counters are not available
+     */
+    bool setCounters(const bool enable);
+
+    /*!
+       \brief monores measures monores_grid_t::timeStepDirection() per dimension
+     */
+    void monores(const size_t level);
+
+    /*!
+       \brief multires measures the phases of multires_grid_t
+
+       One repetition does a time step by node_t::updateFlow() and
+       node_t::timeStep() per dimension, calls node_t::getNeighbour() for all
+       orientations of all leaves, branches and debranches all leaves above
+       the finest level and remeshes the grid phase by phase.
+     */
+    void multires(const size_t level, const real epsilon);
+
+    const std::vector<result_t> &results() const
+    { return m_results; }
+
+private:
+    /*!
+       \brief sample measures a repetition
+
+       The counters are read before and after the wall clock time is taken,
+       so reading them does not add to the time.
+     */
+    template<typename function_type>
+    sample_t sample(function_type function, const size_t items);
+
+    /*!
+       \brief add summarises the samples of a benchmark
+
+       The first repetition warms up the caches and the pools, so it is dropped.
+     */
+    void add(const std::string &name, const size_t level, const real epsilon, std::vector<sample_t> samples);
+
+    //! the flux loop of multires_grid_t::sweep()
+    template<bool limiter>
+    static void updateFlows(const std::vector<node_t *> &leaves, const char direction, const real dt);
+
+    const size_t m_repeat;
+    const field_generator_t m_f_eval;
+    int m_threads;
+    bool m_counters;
+    perf_team_t m_team; //!< counters of the OpenMP threads if m_counters
+    size_t m_checksum; //!< keeps the results of the calls which only read
+    std::vector<result_t> m_results;
+};
+
+void benchmark_t::setThreads(const int threads)
+{
+    #ifdef _OPENMP
+    omp_set_num_threads(threads);
+    m_threads = threads;
+    #else
+    (void)threads;
+    m_threads = 1;
+    #endif
+    // the groups count for the threads which opened them
+    if (m_counters && !setCounters(true)) {
+        std::cerr << "hardware counters are not available for " << m_threads << " threads" << std::endl;
+    }
+}
+
+bool benchmark_t::setCounters(const bool enable)
+{
+    m_team = perf_team_t();
+    m_counters = enable && m_team.open();
+    return m_counters;
+}
+
+template<typename function_type>
+sample_t benchmark_t::sample(function_type function, const size_t items)
+{
+    sample_t result;
+    const perf_values_t before = m_counters ? m_team.read() : perf_values_t();
+    result.seconds = seconds(function);
+    result.items = items;
+    result.events = m_counters ? perfDifference(m_team.read(), before) : perf_values_t();
+    return result;
+}
+
+void benchmark_t::add(const std::string &name, const size_t level, const real epsilon, std::vector<sample_t> samples)
+{
+    if (samples.size() > 1) {
+        samples.erase(samples.begin());
+    }
+    std::sort(samples.begin(), samples.end(), [](const sample_t &a, const sample_t &b) {
+        return a.seconds*b.items < b.seconds*a.items;
+    });
+    const sample_t &fastest = samples.front();
+    const sample_t &median = samples[samples.size()/2];
+    std::array<double, perfCount> events;
+    for (size_t counter = 0; counter < perfCount; ++counter) {
+        events[counter] = double(median.events[counter])/std::max<size_t>(median.items, 1);
+    }
+    m_results.push_back({name, level, epsilon, m_threads, samples.size(), median.items,
+                         fastest.seconds/std::max<size_t>(fastest.items, 1),
+                         median.seconds/std::max<size_t>(median.items, 1), events});
+}
+
+template<bool limiter>
+void benchmark_t::updateFlows(const std::vector<node_t *> &leaves, const char direction, const real dt)
+{
+    const size_t count = leaves.size();
+    #pragma omp parallel for schedule(guided)
+    for (size_t i = 0; i < count; ++i) {
+        leaves[i]->updateFlow<limiter>(direction, dt);
+    }
+}
+
+void benchmark_t::monores(const size_t level)
+{
+    std::cerr << "benchmarking monores: level " << level << ", " << m_threads << " threads" << std::endl;
+    monores_grid_t grid(level, m_f_eval);
+
+    std::array<std::vector<sample_t>, g_dimension> sweeps;
+    for (size_t i = 0; i <= m_repeat; ++i) {
+        for (u_char dim = 0; dim < g_dimension; ++dim) {
+            sweeps[dim].push_back(sample([&]() { grid.timeStepDirection(dim); }, grid.NN));
+        }
+    }
+    grid.m_points_valid = false;
+
+    for (u_char dim = 0; dim < g_dimension; ++dim) {
+        add(std::string("monores.timeStepDirection.") + "xyz"[dim], level, 0, sweeps[dim]);
+    }
+}
+
+void benchmark_t::multires(const size_t level, const real epsilon)
+{
+    std::cerr << "benchmarking multires: level " << level << ", epsilon " << epsilon
+              << ", " << m_threads << " threads" << std::endl;
+    multires_grid_t grid(level, 0, epsilon, m_f_eval);
+
+    std::array<std::vector<sample_t>, g_dimension> flows, steps;
+    std::vector<sample_t> neighbours, branches, debranches, analyses, savety, cleans, topologies;
+    for (size_t i = 0; i <= m_repeat; ++i) {
+        const std::vector<node_t *> &leaves = grid.m_leaves;
+        const size_t count = leaves.size();
+
+        // a time step without the remesh, see multires_grid_t::sweep()
+        for (u_char dim = 0; dim < g_dimension; ++dim) {
+            const char direction = node_t::orientation(dim, true);
+            flows[dim].push_back(sample([&]() {
+                if (g_limiter) {
+                    updateFlows<true>(leaves, direction, grid.dt);
+                } else {
+                    updateFlows<false>(leaves, direction, grid.dt);
+                }
+            }, count));
+            steps[dim].push_back(sample([&]() {
+                #pragma omp parallel for schedule(guided)
+                for (size_t j = 0; j < count; ++j) {
+                    leaves[j]->timeStep(direction, grid.dt);
+                }
+            }, count));
+        }
+
+        size_t found = 0;
+        neighbours.push_back(sample([&]() {
+            #pragma omp parallel for schedule(guided) reduction(+:found)
+            for (size_t j = 0; j < count; ++j) {
+                for (char orientation = 0; orientation < g_orientations; ++orientation) {
+                    found += leaves[j]->getNeighbour(orientation)->getLevel();
+                }
+            }
+        }, count*g_orientations));
+        m_checksum += found;
+
+        // serially, as the new children are visible to getNeighbour() of the
+        // neighbouring leaves; the tree is restored by debranch()
+        std::vector<node_t *> parents;
+        for (node_t *leaf: leaves) {
+            if (leaf->getLevel() < level) {
+                parents.push_back(leaf);
+            }
+        }
+        branches.push_back(sample([&]() {
+            for (node_t *parent: parents) {
+                parent->branch(grid, 1);
+            }
+        }, parents.size()));
+        debranches.push_back(sample([&]() {
+            for (node_t *parent: parents) {
+                parent->debranch(grid);
+            }
+        }, parents.size()));
+
+        size_t nodes = 0;
+        for (const std::vector<node_t *> &level_nodes: grid.m_levels) {
+            nodes += level_nodes.size();
+        }
+        analyses.push_back(sample([&]() { grid.remeshAnalyse(); }, nodes));
+        savety.push_back(sample([&]() { grid.remeshSavety(); }, nodes));
+        cleans.push_back(sample([&]() { grid.remeshClean(); }, nodes));
+        topologies.push_back(sample([&]() { grid.updateTopology(); }, grid.m_leaves.size()));
+    }
+
+    for (u_char dim = 0; dim < g_dimension; ++dim) {
+        add(std::string("multires.updateFlow.") + "xyz"[dim], level, epsilon, flows[dim]);
+        add(std::string("multires.timeStep.") + "xyz"[dim], level, epsilon, steps[dim]);
+    }
+    add("multires.getNeighbour", level, epsilon, neighbours);
+    add("multires.branch", level, epsilon, branches);
+    add("multires.debranch", level, epsilon, debranches);
+    add("multires.remesh_analyse", level, epsilon, analyses);
+    add("multires.remesh_savety", level, epsilon, savety);
+    add("multires.remesh_clean", level, epsilon, cleans);
+    add("multires.updateTopology", level, epsilon, topologies);
+}
+
+/*!
+   \brief parseList reads values separated by commas or spaces
+   \return false if a value is invalid or if there is none
+ */
+template<typename T>
+bool parseList(const std::string &text, std::vector<T> &values)
+{
+    std::string spaced = text;
+    std::replace(spaced.begin(), spaced.end(), ',', ' ');
+    std::istringstream stream(spaced);
+    values.clear();
+    T value;
+    while (stream >> value) {
+        values.push_back(value);
+    }
+    return !values.empty() && stream.eof();
+}
+
+//! writes the results as comma separated values with a header line
+void writeCsv(std::ostream &stream, const std::vector<result_t> &results)
+{
+    stream << "benchmark,dimension,real_size,field_size,limiter,level,epsilon,threads,samples,items,min_ns,median_ns";
+    for (size_t counter = 0; counter < perfCount; ++counter) {
+        stream << "," << perf_group_t::name(perf_counter_t(counter));
+    }
+    stream << "\n";
+    for (const result_t &result: results) {
+        stream << boost::format("%s,%d,%d,%d,%d,%d,%g,%d,%d,%d,%.4g,%.4g")
+                  % result.name % int(g_dimension) % sizeof(real) % sizeof(real_field) % g_limiter
+                  % result.level % result.epsilon % result.threads % result.samples % result.items
+                  % (1e9*result.min) % (1e9*result.median);
+        for (const double events: result.events) {
+            stream << boost::format(",%.4g") % events;
+        }
+        stream << "\n";
+    }
+}
+
+//! writes the results as JSON object, the settings of the build first
+void writeJson(std::ostream &stream, const std::vector<result_t> &results)
+{
+    stream << boost::format("{\n  \"dimension\": %d,\n  \"real_size\": %d,\n  \"field_size\": %d,\n  \"limiter\": %s,\n")
+              % int(g_dimension) % sizeof(real) % sizeof(real_field) % (g_limiter ? "true" : "false");
+    stream << "  \"results\": [";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const result_t &result = results[i];
+        stream << (i ? ",\n" : "\n")
+               << boost::format("    {\"benchmark\": \"%s\", \"level\": %d, \"epsilon\": %g, \"threads\": %d, "
+                                "\"samples\": %d, \"items\": %d, \"min_ns\": %.4g, \"median_ns\": %.4g")
+                  % result.name % result.level % result.epsilon % result.threads % result.samples
+                  % result.items % (1e9*result.min) % (1e9*result.median);
+        for (size_t counter = 0; counter < perfCount; ++counter) {
+            stream << boost::format(", \"%s\": %.4g") % perf_group_t::name(perf_counter_t(counter)) % result.events[counter];
+        }
+        stream << "}";
+    }
+    stream << "\n  ]\n}\n";
+}
+
+int main(int argc, char *argv[])
+{
+    #ifdef _OPENMP
+    const int num_procs = omp_get_num_procs(); //!< number of available processors
+    #else
+    const int num_procs = 1;
+    #endif
+
+    // the options of the benchmarks, the others are passed to config_t
+    std::vector<size_t> levels;
+    std::vector<real> epsilons;
+    std::vector<int> threads;
+    std::vector<size_t> repeat(1, 5);
+    std::string format = "csv";
+    std::string results; // empty for std::cout
+    std::vector<char *> args(1, argv[0]);
+    bool valid = true;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const size_t equal = arg.find('=');
+        const std::string key = arg.substr(0, equal);
+        const std::string value = (equal == std::string::npos) ? "" : arg.substr(equal+1);
+        if (key == "--levels") {
+            valid = parseList(value, levels) && valid;
+        } else if (key == "--epsilons") {
+            valid = parseList(value, epsilons) && valid;
+        } else if (key == "--threads") {
+            valid = parseList(value, threads) && valid;
+        } else if (key == "--repeat") {
+            valid = parseList(value, repeat) && repeat.size() == 1 && repeat[0] > 0 && valid;
+        } else if (key == "--format") {
+            format = value;
+            valid = (format == "csv" || format == "json") && valid;
+        } else if (key == "--results") {
+            results = value;
+        } else {
+            if (key == "--help" || key == "-h") {
+                std::cerr << "benchmark options: [--levels=6,8,...] [--epsilons=4e-3,...] [--threads=1,2,...]\n"
+                          << "                   [--repeat=5] [--format=csv|json] [--results=file]\n";
+            }
+            args.push_back(argv[i]);
+        }
+    }
+    if (!valid) {
+        std::cerr << "invalid benchmark option, see --help" << std::endl;
+        return 1;
+    }
+
+    config_t config;
+    if (!config.parse(int(args.size()), args.data())) {
+        return 1;
+    }
+    if (levels.empty()) {
+        levels.push_back(config.level);
+    }
+    if (epsilons.empty()) {
+        epsilons.push_back(config.epsilon);
+    }
+    if (threads.empty()) {
+        threads.push_back(num_procs);
+    }
+    for (const size_t level: levels) {
+        config.level = level;
+        if (!config.check()) {
+            return 1;
+        }
+    }
+    config.apply();
+
+    benchmark_t benchmark(repeat[0], config.fieldGenerator());
+    if (config.counters && !benchmark.setCounters(true)) {
+        std::cerr << "hardware counters are not available, see perf_event_open(2)" << std::endl;
+    }
+    for (const int count: threads) {
+        benchmark.setThreads(std::max(count, 1));
+        for (const size_t level: levels) {
+            benchmark.monores(level);
+            for (const real epsilon: epsilons) {
+                benchmark.multires(level, epsilon);
+            }
+        }
+    }
+
+    std::ofstream file;
+    if (!results.empty()) {
+        file.open(results);
+    }
+    std::ostream &stream = results.empty() ? std::cout : file;
+    if (format == "json") {
+        writeJson(stream, benchmark.results());
+    } else {
+        writeCsv(stream, benchmark.results());
+    }
+    if (!stream) {
+        std::cerr << "cannot write " << results << std::endl;
+        return 1;
+    }
+    return 0;
+}
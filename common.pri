@@ -1,6 +1,12 @@
 QMAKE_LFLAGS   += -std=c++11
 QMAKE_CXXFLAGS += -std=c++11
 QMAKE_CXXFLAGS += -Wold-style-cast -Wall -Wuninitialized -Wextra
+
+# std::thread, e.g. of snapshot_writer_t
+unix {
+    QMAKE_CXXFLAGS += -pthread
+    QMAKE_LFLAGS   += -pthread
+}
 QMAKE_CXXFLAGS_RELEASE += -funroll-loops # unroll short, iterative for-loops
 QMAKE_CXXFLAGS_RELEASE -= -O2
 QMAKE_CXXFLAGS_RELEASE += -O3
@@ -38,9 +44,18 @@ HEADERS += \
     $$PWD/functions.h \
     $$PWD/theory.hpp \
     $$PWD/point.hpp \
-    $$PWD/grid.hpp
+    $$PWD/morton.hpp \
+    $$PWD/grid.hpp \
+    $$PWD/config.hpp \
+    $$PWD/snapshot.hpp \
+    $$PWD/instrument.hpp \
+    $$PWD/perf.hpp
 
 Release:DEFINES += NDEBUG
 
 SOURCES += \
-    $$PWD/grid.cpp
+    $$PWD/grid.cpp \
+    $$PWD/config.cpp \
+    $$PWD/snapshot.cpp \
+    $$PWD/instrument.cpp \
+    $$PWD/perf.cpp
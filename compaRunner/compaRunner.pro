@@ -16,6 +16,7 @@ HEADERS += ../settings.h \
 
 BACKEND_LIB  = ../multires/libmultires.a
 BACKEND_LIB += ../monores/libmonores.a
+BACKEND_LIB += ../linear/liblinear.a
 
 PRE_TARGETDEPS = $${BACKEND_LIB}
 LIBS          += $${BACKEND_LIB}
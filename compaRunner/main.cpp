@@ -15,6 +15,7 @@
  ****************************************************************************************/
 
 #include <string>
+#include <vector>
 #include <memory>
 #include <fstream>
 #include <iostream>
@@ -25,19 +26,185 @@
 
 #include "multires/multires_grid.hpp"
 #include "monores/monores_grid.hpp"
+#include "linear/linear_grid.hpp"
 #include "theory.hpp"
 
+#include "config.hpp"
 #include "functions.h"
 
+#define NORM_L_INF // uncomment to use L_1 norm
+
+/*!
+   \brief norm gives the difference of a grid to the theoretical solution
+   \param grid with the points of the finest level, i.e. unfolded
+   \param theory solution of the same level
+   \return maximum norm with NORM_L_INF, otherwise the L_1 norm
+
+   The points are processed by a parallel loop with a reduction. The theory is
+   evaluated in batches, see theory_t::at(const index_t *, size_t, real, real *).
+ */
+real norm(grid_t &grid, const theory_t &theory)
+{
+    const real time = grid.getTime();
+    const grid_t::iterator first = grid.begin();
+    const std::ptrdiff_t count = grid.end() - first;
+    const std::ptrdiff_t batch = 256;
+#ifdef NORM_L_INF
+    real norm = g_eps;
+    #pragma omp parallel reduction(max:norm)
+#else
+    real norm = 0;
+    #pragma omp parallel reduction(+:norm)
+#endif
+    {
+        std::vector<index_t> index(batch);
+        std::vector<real> values(batch);
+
+        #pragma omp for schedule(static)
+        for (std::ptrdiff_t b = 0; b < count; b += batch) {
+            const grid_t::iterator points = first + b;
+            const std::ptrdiff_t n = std::min(batch, count - b);
+            for (std::ptrdiff_t i = 0; i < n; ++i) {
+                index[i] = (points + i)->m_index;
+            }
+            theory.at(index.data(), n, time, values.data());
+            for (std::ptrdiff_t i = 0; i < n; ++i) {
+                const real diff = std::fabs((points + i)->m_phi - values[i]);
+#ifdef NORM_L_INF
+                norm = std::max(norm, diff);
+#else
+                norm += diff/count;
+#endif
+            }
+        }
+    }
+    return norm;
+}
+
+//! passes the remesh settings of the configuration to a multires_grid_t
+template<typename multires_backend_t>
+void applyRemesh(multires_backend_t &, const config_t &)
+{}
+
+void applyRemesh(multires_grid_t &grid, const config_t &config)
+{ config.applyRemesh(grid); }
+
+/*!
+   \brief multiresNorm computes on a multi resolution grid and compares the result to the theory
+   \tparam multires_backend_t multires_grid_t (pointer tree) or linear_grid_t (linear tree)
+   \param size receives the number of points before unfolding
+   \return see norm()
+ */
+template<typename multires_backend_t>
+real multiresNorm(const size_t level, const real epsilon, const real simulationTime,
+                  const theory_t &theory, const field_generator_t &f_eval, const config_t &config,
+                  size_t &size)
+{
+    multires_backend_t grid(level, 0, epsilon, f_eval);
+    applyRemesh(grid, config);
+    do {
+        grid.timeStep();
+    } while(grid.getTime() < simulationTime);
+    /*
+    for (size_t loops = 0; loops < loops_max; ++loops) {
+        grid.timeStep();
+    }
+    */
+
+    size = grid.size();
 
-int main()
+    grid.unfold(level);
+
+    return norm(grid, theory);
+}
+
+/*!
+   \brief monoresNorm computes on a regular grid and compares the result to the theory
+   \return see norm()
+ */
+real monoresNorm(const size_t level, const real simulationTime, const theory_t &theory,
+                 const field_generator_t &f_eval)
+{
+    monores_grid_t grid(level, f_eval);
+    do {
+        grid.timeStep();
+    } while(grid.getTime() < simulationTime);
+
+    return norm(grid, theory);
+}
+
+/*!
+   \brief The job_t struct is one configuration of the parameter sweep
+ */
+struct job_t {
+    size_t i_level;   //!< index in the levels of the sweep
+    size_t i_epsilon; //!< index in the thresholds of the sweep, unused for the regular grid
+    bool   regular;   //!< regular grid instead of the multi resolution grid
+    real   norm;      //!< result, see norm()
+    size_t size;      //!< number of points before unfolding
+};
+
+/*!
+   \brief sweep computes the jobs concurrently and fills in their results
+
+   The grids are independent of each other, so every OpenMP thread computes
+   whole jobs one after the other while the parallel loops inside the grids
+   run serially. The jobs are taken from a shared queue ordered by the
+   expected work, the finest levels first and within a level the multi
+   resolution grids with the smallest threshold first, so the long jobs do
+   not end up on a single thread at the end of the sweep.
+
+   \param compute is called with a job and has to be thread safe
+ */
+template<typename F>
+void sweep(std::vector<job_t> &jobs, F compute)
+{
+    std::vector<job_t *> queue;
+    for (job_t &job: jobs) {
+        queue.push_back(&job);
+    }
+    std::stable_sort(queue.begin(), queue.end(), [](const job_t *a, const job_t *b) {
+        if (a->i_level != b->i_level) {
+            return a->i_level > b->i_level;
+        }
+        if (a->regular != b->regular) {
+            return b->regular;
+        }
+        return a->i_epsilon < b->i_epsilon;
+    });
+
+    #ifdef _OPENMP
+    const int levels = omp_get_max_active_levels();
+    omp_set_max_active_levels(1);
+    #endif
+
+    const std::ptrdiff_t count = queue.size();
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (std::ptrdiff_t i = 0; i < count; ++i) {
+        compute(*queue[i]);
+    }
+
+    #ifdef _OPENMP
+    omp_set_max_active_levels(levels);
+    #endif
+}
+
+int main(int argc, char *argv[])
 {
     ///////////// CONFIG //////////////////////
-#define NORM_L_INF // uncomment to use L_1 norm
 #define MONORES_TEST
 #define MULTIRES_TEST
 
-    real simulationTime = g_span[dimX]/g_velocity; // 1 period
+    // grid selects the multi resolution grid: multires or linear, level and epsilon are varied below
+    config_t config;
+    config.output = "/tmp/output.dat";
+    if (!config.parse(argc, argv)) {
+        return 1;
+    }
+    config.apply();
+    const field_generator_t f_eval = config.fieldGenerator();
+
+    real simulationTime = g_span[dimX]/g_velocity*config.periods; // 1 period by default
     // size_t loops_max = 100;
 
     std::array<real,6> steps_level;
@@ -61,7 +228,7 @@ int main()
     */
 
     // setup output stream
-    std::ofstream file("/tmp/output.dat");
+    std::ofstream file(config.output);
     ///////////// CONFIG END //////////////////////
 
     enum {
@@ -80,12 +247,50 @@ int main()
     std::cerr << "use NORM_L_1 (sum)" << std::endl;
 #endif
 
+    std::vector<theory_t> theories;
+    theories.reserve(steps_level.size());
+    std::vector<job_t> jobs;
+    for(size_t i_level = 0; i_level < steps_level.size(); ++i_level) {
+        theories.emplace_back(steps_level[i_level], f_eval);
+#ifdef MONORES_TEST
+        jobs.push_back({i_level, 0, true, 0, 0});
+#endif
+#ifdef MULTIRES_TEST
+        for(size_t i_epsilon = 0; i_epsilon < steps_epsilon.size(); ++i_epsilon) {
+            jobs.push_back({i_level, i_epsilon, false, 0, 0});
+        }
+#endif
+    }
+
+    sweep(jobs, [&](job_t &job) {
+        const size_t level = steps_level[job.i_level];
+        const size_t N     = pow(1 << level,g_dimension);
+        const theory_t &theory = theories[job.i_level];
+
+        if (job.regular) {
+            // regular grid computation
+            job.norm = monoresNorm(level, simulationTime, theory, f_eval);
+            job.size = N;
+            #pragma omp critical(output)
+            std::cerr << "finished regular grid with level " << level << std::endl;
+        } else {
+            // multiresolution grid computation (epsilon variable)
+            const real epsilon = steps_epsilon[job.i_epsilon];
+            job.norm = (config.grid == gridLinear)
+                    ? multiresNorm<linear_grid_t>(level, epsilon, simulationTime, theory, f_eval, config, job.size)
+                    : multiresNorm<multires_grid_t>(level, epsilon, simulationTime, theory, f_eval, config, job.size);
+            #pragma omp critical(output)
+            std::cerr << "finished level " << level << " eps " << epsilon << " with nodes/N: " << real(job.size)/N << std::endl;
+        }
+    });
+
+    // the rows are written in the order of the levels and thresholds
+    size_t i_job = 0;
     for(size_t i_level = 0; i_level < steps_level.size(); ++i_level) {
         const size_t level = steps_level[i_level];
         const size_t N     = pow(1 << level,g_dimension);
 
         y_values_diff_norm[i_level][yTheory] = g_eps;
-        const theory_t theory(level);
 
         // output row for theory
         // format: level N epsilon norm
@@ -96,85 +301,21 @@ int main()
                 % g_eps;
 
 #ifdef MONORES_TEST
-        // regular grid computation
-        {
-
-            monores_grid_t grid(level);
-            do {
-                grid.timeStep();
-            } while(grid.getTime() < simulationTime);
-            /*
-            for (size_t loops = 0; loops < loops_max; ++loops) {
-                grid.timeStep();
-            }
-            */
-
-#ifdef NORM_L_INF
-            y_values_diff_norm[i_level][yGridRegular] = g_eps;
-#else
-            y_values_diff_norm[i_level][yGridRegular] = 0;
-#endif
-            for (const point_t &point: grid) {
-                real diff = std::fabs(theory.at(point.m_index, grid.getTime()) - point.m_phi);
-#ifdef NORM_L_INF
-                if(y_values_diff_norm[i_level][yGridRegular] < diff) {
-                    y_values_diff_norm[i_level][yGridRegular] = diff;
-                    // std::cerr << boost::format("x:%03d y:%03d phi: %e\n") % point.m_index[dimX] % point.m_index[dimY] % point.m_phi;
-                }
-#else
-                y_values_diff_norm[i_level][yGridRegular] += diff/N;
-#endif
-            }
-            std::cerr << "finished regular grid with level " << level << std::endl;
+        y_values_diff_norm[i_level][yGridRegular] = jobs[i_job++].norm;
 
-            // output row for regular grid
-            // format: level N epsilon norm
-            file << boost::format("%d %d %e %e # regular\n")
-                    % level
-                    % N
-                    % steps_epsilon[0]
-                    % y_values_diff_norm[i_level][yGridRegular];
-
-            // std::cerr << "\n\n\n";
-        }       
+        // output row for regular grid
+        // format: level N epsilon norm
+        file << boost::format("%d %d %e %e # regular\n")
+                % level
+                % N
+                % steps_epsilon[0]
+                % y_values_diff_norm[i_level][yGridRegular];
 #endif
 
 #ifdef MULTIRES_TEST
-        // multiresolution grid computation (epsilon variable)
         for(size_t i_epsilon = 0; i_epsilon < steps_epsilon.size(); ++i_epsilon) {
             const real epsilon = steps_epsilon[i_epsilon];
-
-            multires_grid_t grid(level, 0, epsilon);
-            do {
-                grid.timeStep();
-            } while(grid.getTime() < simulationTime);
-            /*
-            for (size_t loops = 0; loops < loops_max; ++loops) {
-                grid.timeStep();
-            }
-            */
-
-            size_t size = grid.size();
-
-            grid.unfold(level);
-
-#ifdef NORM_L_INF
-            y_values_diff_norm[i_level][yGridMulti+i_epsilon] = g_eps;
-#else
-            y_values_diff_norm[i_level][yGridMulti+i_epsilon] = 0;
-#endif
-
-            for (const point_t &point: grid) {
-                real diff = std::fabs(point.m_phi - theory.at(point.m_index, grid.getTime()));
-#ifdef NORM_L_INF
-                if(y_values_diff_norm[i_level][yGridMulti+i_epsilon] < diff) {
-                    y_values_diff_norm[i_level][yGridMulti+i_epsilon] = diff;
-                }
-#else
-                y_values_diff_norm[i_level][yGridMulti+i_epsilon] += diff/N;
-#endif
-            }
-            std::cerr << "finished level " << level << " eps " << epsilon << " with nodes/N: " << real(size)/N << std::endl;
+            y_values_diff_norm[i_level][yGridMulti+i_epsilon] = jobs[i_job++].norm;
 
             // output row for multiresolution grid
             // format: level N epsilon norm
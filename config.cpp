@@ -0,0 +1,400 @@
+/***************************************************************************************
+ * Copyright (c) 2014 Robert Riemann <robert@riemann.cc>                                *
+ *                                                                                      *
+ * This program is free software; you can redistribute it and/or modify it under        *
+ * the terms of the GNU General Public License as published by the Free Software        *
+ * Foundation; either version 2 of the License, or (at your option) any later           *
+ * version.                                                                             *
+ *                                                                                      *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY      *
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A      *
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.             *
+ *                                                                                      *
+ * You should have received a copy of the GNU General Public License along with         *
+ * this program.  If not, see <http://www.gnu.org/licenses/>.                           *
+ ****************************************************************************************/
+
+#include <cstdlib>
+#include <algorithm>
+#include <cerrno>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+
+#include "config.hpp"
+#include "functions.h"
+
+// runtime globals of settings.h
+real       g_cfl      = 0.1;
+real       g_velocity = 0.5;
+location_t g_x0       = uniform(0);
+location_t g_x1       = uniform(1);
+location_t g_span     = difference(g_x0, g_x1);
+#ifdef LIMITER
+bool       g_limiter  = true;
+#else
+bool       g_limiter  = false;
+#endif
+
+namespace {
+
+const char *c_grid_names[] = { "regular", "multires", "linear" };
+
+//! removes leading and trailing white space
+std::string trim(const std::string &text)
+{
+    const char *space = " \t\r\n";
+    const size_t first = text.find_first_not_of(space);
+    if (first == std::string::npos) {
+        return std::string();
+    }
+    return text.substr(first, text.find_last_not_of(space) - first + 1);
+}
+
+bool parseReal(const std::string &text, real &value)
+{
+    const char *begin = text.c_str();
+    char *end;
+    errno = 0;
+    const double result = std::strtod(begin, &end);
+    if (end == begin || *end != '\0' || errno) {
+        return false;
+    }
+    value = result;
+    return true;
+}
+
+bool parseSize(const std::string &text, size_t &value)
+{
+    const char *begin = text.c_str();
+    char *end;
+    errno = 0;
+    const unsigned long long result = std::strtoull(begin, &end, 10);
+    if (end == begin || *end != '\0' || errno || text[0] == '-') {
+        return false;
+    }
+    value = result;
+    return true;
+}
+
+bool parseBool(const std::string &text, bool &value)
+{
+    if (text == "1" || text == "true" || text == "on" || text == "yes") {
+        value = true;
+    } else if (text == "0" || text == "false" || text == "off" || text == "no") {
+        value = false;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+//! reads g_dimension values separated by white space or commas, a single value is used for all dimensions
+bool parseLocation(std::string text, location_t &value)
+{
+    for (char &c: text) {
+        if (c == ',') {
+            c = ' ';
+        }
+    }
+    std::istringstream stream(text);
+    std::vector<real> values;
+    std::string word;
+    while (stream >> word) {
+        real x;
+        if (!parseReal(word, x)) {
+            return false;
+        }
+        values.push_back(x);
+    }
+    if (values.size() == 1) {
+        value = uniform(values[0]);
+    } else if (values.size() == g_dimension) {
+        std::copy(values.begin(), values.end(), value.begin());
+    } else {
+        return false;
+    }
+    return true;
+}
+
+void printUsage(const char *name, const config_t &config)
+{
+    std::cerr << "usage: " << name << " [--config=file] [--key=value ...] [--help]\n"
+              << "keys and their current values:\n";
+    config.print(std::cerr);
+}
+
+} // namespace
+
+config_t::config_t() :
+#if defined(REGULAR)
+    grid(gridRegular)
+#elif defined(LINEAR)
+    grid(gridLinear)
+#else
+    grid(gridMultires)
+#endif
+  , level(g_level)
+  , epsilon(g_epsilon)
+  , cfl(g_cfl)
+  , velocity(g_velocity)
+  , x0(g_x0)
+  , x1(g_x1)
+  , limiter(g_limiter)
+  , field("gauss")
+  , precision(g_precision)
+  , incremental(false)
+  , remesh_tolerance(0.1)
+  , remesh_period(1)
+  , remesh_distance(0)
+  , periods(1)
+  , output("/tmp/output.txt")
+  , snapshot_steps(0)
+  , snapshot_layout(layoutLeaves)
+  , counters(false)
+{
+}
+
+bool config_t::set(const std::string &key, const std::string &value)
+{
+    bool valid = true;
+    if (key == "grid") {
+        valid = false;
+        for (u_char i = 0; i < 3; ++i) {
+            if (value == c_grid_names[i]) {
+                grid = grid_type_t(i);
+                valid = true;
+            }
+        }
+    } else if (key == "level") {
+        valid = parseSize(value, level);
+    } else if (key == "epsilon") {
+        valid = parseReal(value, epsilon);
+    } else if (key == "cfl") {
+        valid = parseReal(value, cfl);
+    } else if (key == "velocity") {
+        valid = parseReal(value, velocity);
+    } else if (key == "x0") {
+        valid = parseLocation(value, x0);
+    } else if (key == "x1") {
+        valid = parseLocation(value, x1);
+    } else if (key == "limiter") {
+        valid = parseBool(value, limiter);
+    } else if (key == "field") {
+        valid = (value == "gauss" || value == "square" || value == "hat");
+        if (valid) {
+            field = value;
+        }
+    } else if (key == "precision") {
+        valid = (value == "double" || value == "single" || value == "mixed");
+        if (valid) {
+            precision = value;
+        }
+    } else if (key == "remesh") {
+        valid = (value == "full" || value == "incremental");
+        if (valid) {
+            incremental = (value == "incremental");
+        }
+    } else if (key == "remesh_tolerance") {
+        valid = parseReal(value, remesh_tolerance);
+    } else if (key == "remesh_period") {
+        valid = parseSize(value, remesh_period);
+    } else if (key == "remesh_distance") {
+        valid = parseReal(value, remesh_distance);
+    } else if (key == "periods") {
+        valid = parseReal(value, periods);
+    } else if (key == "output") {
+        output = value;
+    } else if (key == "snapshots") {
+        snapshots = value;
+    } else if (key == "snapshot_steps") {
+        valid = parseSize(value, snapshot_steps);
+    } else if (key == "snapshot_layout") {
+        valid = (value == "leaves" || value == "points");
+        if (valid) {
+            snapshot_layout = (value == "leaves") ? layoutLeaves : layoutPoints;
+        }
+    } else if (key == "restart") {
+        restart = value;
+    } else if (key == "instrument") {
+        instrument = value;
+    } else if (key == "counters") {
+        valid = parseBool(value, counters);
+    } else {
+        std::cerr << "unknown configuration key: " << key << std::endl;
+        return false;
+    }
+
+    if (!valid) {
+        std::cerr << "invalid value of " << key << ": " << value << std::endl;
+    }
+    return valid;
+}
+
+bool config_t::read(const std::string &filename)
+{
+    std::ifstream file(filename);
+    if (!file) {
+        std::cerr << "cannot read configuration file: " << filename << std::endl;
+        return false;
+    }
+
+    bool valid = true;
+    std::string line;
+    for (size_t number = 1; std::getline(file, line); ++number) {
+        line = trim(line.substr(0, line.find_first_of("#;")));
+        if (line.empty() || (line.front() == '[' && line.back() == ']')) {
+            continue;
+        }
+        const size_t equal = line.find('=');
+        if (equal == std::string::npos) {
+            std::cerr << filename << ":" << number << ": expected key = value" << std::endl;
+            valid = false;
+            continue;
+        }
+        valid = set(trim(line.substr(0, equal)), trim(line.substr(equal+1))) && valid;
+    }
+    return valid;
+}
+
+bool config_t::parse(int argc, char *argv[])
+{
+    // the configuration file is read first, so the command line overrides it
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg.compare(0, 9, "--config=") == 0 && !read(arg.substr(9))) {
+            return false;
+        }
+    }
+
+    bool valid = true;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const size_t equal = arg.find('=');
+        if (arg == "--help" || arg == "-h") {
+            printUsage(argv[0], *this);
+            return false;
+        } else if (arg.compare(0, 2, "--") != 0 || equal == std::string::npos) {
+            std::cerr << "invalid argument: " << arg << std::endl;
+            valid = false;
+        } else if (arg.compare(0, 9, "--config=") != 0) {
+            valid = set(arg.substr(2, equal-2), arg.substr(equal+1)) && valid;
+        }
+    }
+
+    if (!valid) {
+        printUsage(argv[0], *this);
+        return false;
+    }
+    return check();
+}
+
+bool config_t::check() const
+{
+    bool valid = true;
+    if (level < 1 || g_dimension*level >= 8*sizeof(size_t) || level > 30) {
+        std::cerr << "level out of range: " << level << std::endl;
+        valid = false;
+    }
+    if (!(epsilon >= 0)) {
+        std::cerr << "epsilon has to be non-negative" << std::endl;
+        valid = false;
+    }
+    // the grids are compiled for one precision, see settings.h
+    if (precision != g_precision) {
+        std::cerr << "precision " << precision << " needs a build with "
+                  << (precision == "double" ? "neither SINGLE nor MIXED" : (precision == "single" ? "SINGLE" : "MIXED"))
+                  << ", this one computes in " << g_precision << std::endl;
+        valid = false;
+    }
+    if (!(cfl > 0 && cfl <= 1)) {
+        std::cerr << "cfl has to be in (0, 1]" << std::endl;
+        valid = false;
+    }
+    // the fluxes are upwind for positive velocities only
+    if (!(velocity > 0)) {
+        std::cerr << "velocity has to be positive" << std::endl;
+        valid = false;
+    }
+    for (u_char dim = 0; dim < g_dimension; ++dim) {
+        if (!(x0[dim] < x1[dim])) {
+            std::cerr << "x0 has to be lower than x1 in all dimensions" << std::endl;
+            valid = false;
+            break;
+        }
+    }
+    if (!(remesh_tolerance >= 0)) {
+        std::cerr << "remesh_tolerance has to be non-negative" << std::endl;
+        valid = false;
+    }
+    if (remesh_period < 1) {
+        std::cerr << "remesh_period has to be at least 1" << std::endl;
+        valid = false;
+    }
+    if (!(remesh_distance >= 0)) {
+        std::cerr << "remesh_distance has to be non-negative" << std::endl;
+        valid = false;
+    } else if (remesh_distance > 0 && remesh_period != 1) {
+        std::cerr << "remesh_period and remesh_distance cannot be combined" << std::endl;
+        valid = false;
+    }
+    if (!(periods >= 0)) {
+        std::cerr << "periods has to be non-negative" << std::endl;
+        valid = false;
+    }
+    return valid;
+}
+
+void config_t::apply() const
+{
+    g_cfl      = cfl;
+    g_velocity = velocity;
+    g_x0       = x0;
+    g_x1       = x1;
+    g_span     = difference(x0, x1);
+    g_limiter  = limiter;
+}
+
+field_generator_t config_t::fieldGenerator() const
+{
+    if (field == "square") {
+        return f_eval_square_t();
+    } else if (field == "hat") {
+        return f_eval_hat_t();
+    }
+    return f_eval_gauss_t();
+}
+
+void config_t::print(std::ostream &stream) const
+{
+    const auto location = [](const location_t &x) {
+        std::ostringstream text;
+        for (u_char dim = 0; dim < g_dimension; ++dim) {
+            text << (dim ? " " : "") << x[dim];
+        }
+        return text.str();
+    };
+
+    stream << "grid            = " << c_grid_names[grid] << "\n"
+           << "level           = " << level << "\n"
+           << "epsilon         = " << epsilon << "\n"
+           << "precision       = " << precision << "\n"
+           << "cfl             = " << cfl << "\n"
+           << "velocity        = " << velocity << "\n"
+           << "x0              = " << location(x0) << "\n"
+           << "x1              = " << location(x1) << "\n"
+           << "limiter         = " << (limiter ? "on" : "off") << "\n"
+           << "field           = " << field << "\n"
+           << "remesh          = " << (incremental ? "incremental" : "full") << "\n"
+           << "remesh_tolerance = " << remesh_tolerance << "\n"
+           << "remesh_period   = " << remesh_period << "\n"
+           << "remesh_distance = " << remesh_distance << "\n"
+           << "periods         = " << periods << "\n"
+           << "output          = " << output << "\n"
+           << "snapshots       = " << snapshots << "\n"
+           << "snapshot_steps  = " << snapshot_steps << "\n"
+           << "snapshot_layout = " << (snapshot_layout == layoutLeaves ? "leaves" : "points") << "\n"
+           << "restart         = " << restart << "\n"
+           << "instrument      = " << instrument << "\n"
+           << "counters        = " << (counters ? "on" : "off") << std::endl;
+}
@@ -0,0 +1,165 @@
+/***************************************************************************************
+ * Copyright (c) 2014 Robert Riemann <robert@riemann.cc>                                *
+ *                                                                                      *
+ * This program is free software; you can redistribute it and/or modify it under        *
+ * the terms of the GNU General Public License as published by the Free Software        *
+ * Foundation; either version 2 of the License, or (at your option) any later           *
+ * version.                                                                             *
+ *                                                                                      *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY      *
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A      *
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.             *
+ *                                                                                      *
+ * You should have received a copy of the GNU General Public License along with         *
+ * this program.  If not, see <http://www.gnu.org/licenses/>.                           *
+ ****************************************************************************************/
+/*! \file config.hpp
+
+    \author Robert Riemann (robert@riemann.cc)
+
+    \brief runtime configuration of the runners
+
+    The parameters that do not change the types of the computation are read
+    from an INI file and the command line instead of settings.h. DIMENSION,
+    SINGLE and MIXED stay compile-time settings.
+ */
+
+#ifndef CONFIG_HPP
+#define CONFIG_HPP
+
+#include <string>
+#include <iosfwd>
+
+#include "settings.h"
+#include "snapshot.hpp"
+
+/*!
+   \brief enumerates the grids a runner can compute on
+ */
+enum grid_type_t {
+      gridRegular = 0 //!< monores_grid_t
+    , gridMultires    //!< multires_grid_t
+    , gridLinear      //!< linear_grid_t
+};
+
+/*!
+   \brief The config_t struct holds the runtime configuration of a runner
+
+   The defaults are taken from settings.h and the defines REGULAR, LINEAR and
+   LIMITER. An INI file given by `--config=file` is read first, then the other
+   options of the command line in the form `--key=value` override its values:
+
+       # comment
+       [grid]
+       grid            = multires         # regular, multires or linear
+       level           = 7
+       epsilon         = 4e-3
+       precision       = double           # double, single or mixed, has to match the build
+       [physics]
+       cfl             = 0.1
+       velocity        = 0.5
+       x0              = 0 0              # a single value for all dimensions
+       x1              = 1 1
+       limiter         = off
+       field           = gauss            # gauss, square or hat
+       [remesh]
+       remesh          = full             # full or incremental, multires grid only
+       remesh_tolerance = 0.1             # change relative to epsilon that makes a leaf dirty
+       remesh_period   = 1                # time steps between two remeshes
+       remesh_distance = 0                # or cells of the finest level, 0 to use the period
+       [run]
+       periods         = 5
+       output          = /tmp/output.txt  # empty to skip the text output
+       snapshots       = /tmp/output.snap # binary snapshots, see snapshot.hpp
+       snapshot_steps  = 100              # 0 for the final state only
+       snapshot_layout = leaves           # leaves or points
+       restart         = /tmp/output.snap # continue from the last record of leaves
+       instrument      = /tmp/steps.csv   # time series of instrument.hpp
+       counters        = off              # hardware counters of perf.hpp
+
+   The sections only group the keys. Errors are reported to std::cerr.
+ */
+struct config_t {
+    config_t();
+
+    /*!
+       \brief set changes a value
+       \param key name of the value, see the keys above
+       \param value text of the value
+       \return false if the key is unknown or the value invalid
+     */
+    bool set(const std::string &key, const std::string &value);
+
+    /*!
+       \brief read sets the values given by an INI file
+       \return false if the file cannot be read or has invalid lines
+     */
+    bool read(const std::string &filename);
+
+    /*!
+       \brief parse sets the values given by the command line
+       \return false on errors or if `--help` is given, then the caller should exit
+     */
+    bool parse(int argc, char *argv[]);
+
+    /*!
+       \brief check tests the values for consistency
+       \return false if the values cannot be computed with
+     */
+    bool check() const;
+
+    /*!
+       \brief apply sets the runtime globals of settings.h
+
+       It has to be called before grids or theory_t are created.
+     */
+    void apply() const;
+
+    //! initializer given by \ref field, to be passed to the grids and theory_t
+    field_generator_t fieldGenerator() const;
+
+    /*!
+       \brief applyRemesh passes the remesh settings to a multires_grid_t
+
+       It is a template, so the configuration does not depend on the library
+       of the multi resolution grid.
+     */
+    template<typename multires_type>
+    void applyRemesh(multires_type &grid) const
+    {
+        if (remesh_distance > 0) {
+            grid.setRemeshPolicy(multires_type::remeshDistance, remesh_distance);
+        } else {
+            grid.setRemeshPolicy(multires_type::remeshSteps, remesh_period);
+        }
+        grid.setIncrementalRemesh(incremental, remesh_tolerance);
+    }
+
+    //! writes the values in the format of an INI file
+    void print(std::ostream &stream) const;
+
+    grid_type_t grid;    //!< grid of rawRunner, the multi resolution grid of compaRunner
+    size_t      level;   //!< finest level of the grids, see \ref g_level
+    real        epsilon; //!< threshold of the multi resolution grids, see \ref g_epsilon
+    real        cfl;      //!< see \ref g_cfl
+    real        velocity; //!< see \ref g_velocity
+    location_t  x0;       //!< see \ref g_x0
+    location_t  x1;       //!< see \ref g_x1
+    bool        limiter;  //!< see \ref g_limiter
+    std::string field;    //!< name of the initializer, see functions.h
+    std::string precision; //!< precision of the run, check() fails unless it is the one of the build, see \ref g_precision
+    bool        incremental;      //!< see multires_grid_t::setIncrementalRemesh()
+    real        remesh_tolerance; //!< see multires_grid_t::setIncrementalRemesh()
+    size_t      remesh_period;    //!< time steps between two remeshes, see multires_grid_t::setRemeshPolicy()
+    real        remesh_distance;  //!< cells of the finest level between two remeshes, 0 to use \ref remesh_period
+    real        periods;  //!< simulated time in periods of the domain in x-direction
+    std::string output;   //!< text file the runner writes the final state to, empty to skip it
+    std::string snapshots;      //!< binary file the runner writes snapshots to, empty to skip them
+    size_t      snapshot_steps; //!< time steps between the snapshots, 0 for the final state only
+    snapshot_layout_t snapshot_layout; //!< layout of the snapshots
+    std::string restart;        //!< snapshot file whose last \ref layoutLeaves record is restored, empty to start anew
+    std::string instrument;     //!< file the measurements of the time steps are written to, needs the define INSTRUMENT
+    bool        counters;       //!< read the hardware counters of perf.hpp, see instrument_t::setCounters()
+};
+
+#endif // CONFIG_HPP
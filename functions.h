@@ -31,13 +31,15 @@
 
 
 /*!
-   \brief f_eval_gauss implements a gaussion curve in 2D
+   \brief f_eval_gauss implements a gaussion curve
    \param x location in space
    \return field value
  */
 inline real f_eval_gauss(location_t x) {
-    const real x_shift = pow(x[dimX]-0.5,2)
-                       + pow(x[dimY]-0.5,2);
+    real x_shift = 0;
+    for (u_char dim = 0; dim < g_dimension; ++dim) {
+        x_shift += pow(x[dim]-0.5,2);
+    }
 
     return exp(-200*x_shift*x_shift);
 }
@@ -48,7 +50,11 @@ inline real f_eval_gauss(location_t x) {
    \return field value
  */
 inline real f_eval_square(location_t x) {
-    return (1-4*pow(x[dimX]-0.5,2))*(1-4*pow(x[dimY]-0.5,2));
+    real value = 1;
+    for (u_char dim = 0; dim < g_dimension; ++dim) {
+        value *= 1-4*pow(x[dim]-0.5,2);
+    }
+    return value;
 }
 
 /*!
@@ -65,7 +71,32 @@ inline real f_eval_hat(location_t x) {
     }
 }
 
-const field_generator_t g_f_eval = f_eval_gauss; //!< default initializer
-// const field_generator_t g_f_eval = f_eval_square;
+/*!
+   \brief The field_function_t struct makes a field function a functor with a batched version, see field_generator_t
+
+   The batch loop inlines the function, so the compiler can vectorise it. The
+   calls of exp() are vectorised as well if the math library provides vector
+   versions, e.g. glibc with `-ffast-math`.
+ */
+template<real (*f)(location_t)>
+struct field_function_t {
+    real operator()(const location_t &x) const
+    { return f(x); }
+
+    void operator()(const location_t *x, real *phi, const size_t n) const
+    {
+        #pragma omp simd
+        for (size_t i = 0; i < n; ++i) {
+            phi[i] = f(x[i]);
+        }
+    }
+};
+
+typedef field_function_t<f_eval_gauss>  f_eval_gauss_t;  //!< batched f_eval_gauss()
+typedef field_function_t<f_eval_square> f_eval_square_t; //!< batched f_eval_square()
+typedef field_function_t<f_eval_hat>    f_eval_hat_t;    //!< batched f_eval_hat()
+
+const field_generator_t g_f_eval = f_eval_gauss_t(); //!< default initializer
+// const field_generator_t g_f_eval = f_eval_square_t();
 
 #endif // FUNCTIONS_H
@@ -14,16 +14,74 @@
  * this program.  If not, see <http://www.gnu.org/licenses/>.                           *
  ****************************************************************************************/
 
+#include <algorithm>
+
 #include "grid.hpp"
 #include "functions.h"
 
-grid_t::grid_t()
+const size_t grid_t::c_batch_size;
+
+grid_t::grid_t(const field_generator_t &f_eval) :
+    m_f_eval(f_eval)
 {
 }
 
 size_t grid_t::size()
 {
-    return std::distance(begin(), end());
+    return m_point_index.size();
+}
+
+grid_t::iterator grid_t::begin()
+{
+    return iterator(m_point_index.data());
+}
+
+grid_t::iterator grid_t::end()
+{
+    return iterator(m_point_index.data() + m_point_index.size());
+}
+
+grid_t::range_t grid_t::chunk(size_t part, size_t parts)
+{
+    assert(part < parts);
+    const iterator first = begin();
+    const size_t count = end() - first;
+    range_t range;
+    range.first = first + count*part/parts;
+    range.last  = first + count*(part+1)/parts;
+    return range;
+}
+
+void grid_t::initializePoints()
+{
+    const size_t count = m_point_index.size();
+    const size_t batches = (count + c_batch_size - 1)/c_batch_size;
+    #pragma omp parallel
+    {
+        std::array<location_t, c_batch_size> x;
+        std::array<real, c_batch_size> phi;
+
+        #pragma omp for schedule(static)
+        for (size_t b = 0; b < batches; ++b) {
+            point_t *const *points = m_point_index.data() + b*c_batch_size;
+            const size_t n = std::min(c_batch_size, count - b*c_batch_size);
+            for (size_t i = 0; i < n; ++i) {
+                x[i] = points[i]->m_x;
+            }
+            m_f_eval(x.data(), phi.data(), n);
+            for (size_t i = 0; i < n; ++i) {
+                points[i]->m_phi = phi[i];
+            }
+        }
+    }
+}
+
+real grid_t::timeSteps(size_t count)
+{
+    real time = 0;
+    for (size_t i = 0; i < count; ++i) {
+        time += timeStep();
+    }
+    return time;
 }
 
-field_generator_t grid_t::s_f_eval = g_f_eval;
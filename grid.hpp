@@ -17,26 +17,33 @@
 #ifndef GRID_HPP
 #define GRID_HPP
 
+#include <vector>
+#include <boost/iterator/iterator_facade.hpp>
+
 #include "settings.h"
+#include "functions.h"
 #include "point.hpp"
+#include "instrument.hpp"
 
 class grid_t
 {
 public:
     /*!
-       \brief The iterator class is a helper class to iterate over all points part of a multi resolution grid
+       \brief The iterator class is a helper class to iterate over all points part of a grid
+
+       It walks the contiguous index of pointers \ref m_point_index, so it is a
+       random access iterator and the points can be processed by parallel loops.
      */
     class iterator
             : public boost::iterator_facade<
             iterator
             , point_t
-            , boost::forward_traversal_tag
-            //, boost::bidirectional_traversal_tag
+            , boost::random_access_traversal_tag
             >
     {
     public:
 
-        explicit iterator(point_t* p = nullptr)
+        explicit iterator(point_t *const *p = nullptr)
             : m_point(p)
         {}
 
@@ -44,19 +51,48 @@ public:
         friend class boost::iterator_core_access;
 
         void increment()
-        { m_point = m_point->m_next; }
+        { ++m_point; }
+
+        void decrement()
+        { --m_point; }
+
+        void advance(std::ptrdiff_t n)
+        { m_point += n; }
+
+        std::ptrdiff_t distance_to(iterator const &other) const
+        { return other.m_point - m_point; }
 
         bool equal(iterator const &other) const
         { return this->m_point == other.m_point; }
 
         point_t& dereference() const
-        { return *m_point; }
+        { return **m_point; }
 
-        point_t *m_point;
+        point_t *const *m_point;
     };
 
+    /*!
+       \brief The range_t struct is a contiguous part of the points of a grid, see chunk()
+     */
+    struct range_t {
+        iterator first; //!< first point of the range
+        iterator last; //!< behind the last point of the range
+
+        iterator begin() const
+        { return first; }
 
-    grid_t();
+        iterator end() const
+        { return last; }
+    };
+
+    /*!
+       \brief grid_t
+       \param f_eval initializer of the field, see initializePoints()
+
+       Each grid keeps its own initializer, so grids with different fields
+       can be computed at the same time.
+     */
+    explicit grid_t(const field_generator_t &f_eval = g_f_eval);
 
     /*!
        \brief getTime returns the current global time of this grid
@@ -65,6 +101,12 @@ public:
     real getTime()
     { return m_time; }
 
+    /*!
+       \brief getSteps returns the number of time steps done by this grid
+     */
+    size_t getSteps()
+    { return m_steps; }
+
     /*!
        \brief timeStep evolves the grid to the next point in time
 
@@ -77,21 +119,89 @@ public:
      */
     virtual real timeStep() = 0;
 
+    /*!
+       \brief timeSteps evolves the grid by a number of time steps
+       \param count number of time steps
+
+       The caller promises not to look at the intermediate states, so grids
+       may merge the steps, see monores_grid_t::timeSteps(). The result is the
+       same as calling timeStep() count times.
+
+       \return the time passed
+
+       \sa timeStep()
+     */
+    virtual real timeSteps(size_t count);
+
     /*!
        \brief size gives back the number of points of type point_t in this grid
        \return the number of points in this grid
      */
     virtual size_t size();
 
-    virtual iterator begin() = 0;
-    virtual iterator end() = 0;
+    virtual iterator begin();
+    virtual iterator end();
+
+    /*!
+       \brief chunk splits the points into parts of nearly equal size in the order of iteration
+       \param part number of the requested part, less than parts
+       \param parts number of parts, e.g. the number of threads
+       \return the points of part
+
+       As grids may synchronise their points in begin(), the chunks have to be
+       taken before a parallel region. Each chunk is then processed by one thread.
+     */
+    range_t chunk(size_t part, size_t parts);
 
-    static void setInitalizer(const field_generator_t &f_eval)
-    { s_f_eval = f_eval; }
+    /*!
+       \brief forEach calls f for all points of this grid in a parallel loop
+       \param f is called with a point_t reference and has to be thread safe
+     */
+    template<typename F>
+    void forEach(F f);
+
+    /*!
+       \brief getCellLevels gives the levels of the cells of all points in the order of iteration
+       \param levels receives one level per point
+
+       Each point lies at the lower left corner of its cell, so the point_t::m_index
+       and the level identify the cell, see snapshot_writer_t.
+     */
+    virtual void getCellLevels(std::vector<u_char> &levels) = 0;
+
+    /*!
+       \brief getInstrument gives the measurements of the time steps, see instrument.hpp
+     */
+    instrument_t &getInstrument()
+    { return m_instrument; }
 
 protected:
+    /*!
+       \brief initializePoints sets point_t::m_phi of all points of \ref m_point_index by \ref m_f_eval
+
+       The points are evaluated in parallel in batches of \ref c_batch_size, see
+       field_generator_t.
+     */
+    void initializePoints();
+
+    static const size_t c_batch_size = 256; //!< number of points evaluated at once by initializePoints()
+
     real m_time = 0; ///< global time
-    static field_generator_t s_f_eval;
+    size_t m_steps = 0; ///< number of time steps done, decides about the order of the directions
+    std::vector<point_t *> m_point_index; ///< all points of this grid in the order of iteration, to be kept up to date by the grids
+    instrument_t m_instrument; ///< measurements of the time steps, empty unless INSTRUMENT is defined
+    const field_generator_t m_f_eval; ///< initializer of the field, see initializePoints()
 };
 
+template<typename F>
+void grid_t::forEach(F f)
+{
+    const iterator first = begin();
+    const std::ptrdiff_t count = end() - first;
+    #pragma omp parallel for schedule(static)
+    for (std::ptrdiff_t i = 0; i < count; ++i) {
+        f(*(first + i));
+    }
+}
+
 #endif // GRID_HPP
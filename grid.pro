@@ -2,20 +2,19 @@ TEMPLATE = subdirs
 SUBDIRS  = \
            multires \
            monores \
+           linear \
            rawRunner \
            guiRunner \
-           compaRunner
+           compaRunner \
+           benchRunner
 
 # http://blog.rburchell.com/2013/10/every-time-you-configordered-kitten-dies.html
 
 guiRunner.depends = monores multires
-compaRunner.depends = monores multires
+compaRunner.depends = monores multires linear
 
-contains(DEFINES, REGULAR) {
-    rawRunner.depends = monores
-} else {
-    rawRunner.depends = multires
-}
+rawRunner.depends = monores multires linear
+benchRunner.depends = monores multires
 
 
 OTHER_FILES += README.md
@@ -15,12 +15,19 @@
  ****************************************************************************************/
 
 #include "mainwindow.hpp"
+#include "config.hpp"
 #include <QApplication>
 
 int main(int argc, char *argv[])
 {
-    QApplication a(argc, argv);
-    MainWindow w;
+    QApplication a(argc, argv); // removes the arguments of Qt
+    config_t config;
+    if (!config.parse(argc, argv)) {
+        return 1;
+    }
+    config.apply();
+
+    MainWindow w(config);
     w.show();
     
     return a.exec();
@@ -30,10 +30,13 @@
 #include "monores/monores_grid.hpp"
 #include "theory.hpp"
 
-MainWindow::MainWindow(QWidget *parent) :
+static_assert(g_dimension == 2, "the color maps of guiRunner show 2D grids only");
+
+MainWindow::MainWindow(const config_t &config, QWidget *parent) :
     QMainWindow(parent)
   , ui(new Ui::MainWindow)
-  , N(1 << g_level)
+  , m_config(config)
+  , N(1 << config.level)
   , N2(N*N)
 {
     ui->setupUi(this);
@@ -92,11 +95,11 @@ MainWindow::MainWindow(QWidget *parent) :
     connect(ui->actionRescale, SIGNAL(triggered()), this, SLOT(rescale()));
 
     qDebug();
-    qDebug() << QString("max level: %1").arg(g_level);
+    qDebug() << QString("max level: %1").arg(m_config.level);
 
 
     // initialize theory handler
-    m_theory = new theory_t(g_level);
+    m_theory = new theory_t(m_config.level, m_config.fieldGenerator());
 
     initializeGrids();
     rescale();
@@ -113,8 +116,8 @@ void MainWindow::initializeGrids()
 {
     deleteGrids();
 
-    m_grid_mono  = new monores_grid_t(g_level);
-    m_grid_multi = new multires_grid_t(g_level);
+    m_grid_mono  = new monores_grid_t(m_config.level, m_config.fieldGenerator());
+    m_grid_multi = new multires_grid_t(m_config.level, 0, m_config.epsilon, m_config.fieldGenerator());
 
     replot();
 }
@@ -17,7 +17,7 @@
 #ifndef MAINWINDOW_HPP
 #define MAINWINDOW_HPP
 
-#include "settings.h"
+#include "config.hpp"
 
 #include <QMainWindow>
 
@@ -41,12 +41,14 @@ class MainWindow : public QMainWindow
     Q_OBJECT
     
 public:
-    explicit MainWindow(QWidget *parent = 0);
+    explicit MainWindow(const config_t &config, QWidget *parent = 0);
     ~MainWindow();
     
 private:
     Ui::MainWindow *ui;
 
+    const config_t m_config; //!< level and epsilon of the grids
+
     multires_grid_t *m_grid_multi = nullptr;
     monores_grid_t  *m_grid_mono  = nullptr;
     theory_t *m_theory = nullptr;
@@ -0,0 +1,121 @@
+/***************************************************************************************
+ * Copyright (c) 2014 Robert Riemann <robert@riemann.cc>                                *
+ *                                                                                      *
+ * This program is free software; you can redistribute it and/or modify it under        *
+ * the terms of the GNU General Public License as published by the Free Software        *
+ * Foundation; either version 2 of the License, or (at your option) any later           *
+ * version.                                                                             *
+ *                                                                                      *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY      *
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A      *
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.             *
+ *                                                                                      *
+ * You should have received a copy of the GNU General Public License along with         *
+ * this program.  If not, see <http://www.gnu.org/licenses/>.                           *
+ ****************************************************************************************/
+
+#include <ostream>
+#include <algorithm>
+#include <boost/format.hpp>
+
+#include "instrument.hpp"
+
+constexpr bool instrument_t::c_enabled;
+
+#ifndef INSTRUMENT
+const std::vector<instrument_record_t> instrument_t::m_records;
+#endif
+
+namespace {
+
+//! column names of instrument_phase_t
+const char *const c_phase_names[phaseCount] = {
+    "sweep", "tiles", "flow", "update", "analyse", "savety", "clean", "topology", "incremental"
+};
+
+//! column names of instrument_counter_t
+const char *const c_counter_names[counterCount] = {
+    "branch", "debranch", "neighbour"
+};
+
+} // namespace
+
+void instrument_t::write(std::ostream &stream) const
+{
+    stream << "step,steps,time,leaves";
+    for (const char *name: c_phase_names) {
+        stream << "," << name << "_s";
+    }
+    for (const char *name: c_counter_names) {
+        stream << "," << name;
+    }
+    stream << ",busy_min_s,busy_max_s,busy_sum_s";
+    for (size_t counter = 0; counter < perfCount; ++counter) {
+        stream << "," << perf_group_t::name(perf_counter_t(counter));
+    }
+    stream << "\n";
+
+    for (const instrument_record_t &record: records()) {
+        stream << boost::format("%d,%d,%e,%d") % record.step % record.steps % record.time % record.leaves;
+        for (const double seconds: record.seconds) {
+            stream << boost::format(",%e") % seconds;
+        }
+        for (const size_t count: record.counts) {
+            stream << "," << count;
+        }
+        const auto range = std::minmax_element(record.busy.begin(), record.busy.end());
+        double sum = 0;
+        for (const double busy: record.busy) {
+            sum += busy;
+        }
+        stream << boost::format(",%e,%e,%e")
+                  % (record.busy.empty() ? 0 : *range.first)
+                  % (record.busy.empty() ? 0 : *range.second) % sum;
+        for (size_t counter = 0; counter < perfCount; ++counter) {
+            uint64_t total = 0;
+            for (const perf_values_t &events: record.events) {
+                total += events[counter];
+            }
+            stream << "," << total;
+        }
+        stream << "\n";
+    }
+}
+
+void instrument_t::summary(std::ostream &stream) const
+{
+    std::array<double, phaseCount> seconds{};
+    std::array<perf_values_t, phaseCount> events{};
+    for (const instrument_record_t &record: records()) {
+        for (size_t phase = 0; phase < phaseCount; ++phase) {
+            seconds[phase] += record.seconds[phase];
+            for (size_t counter = 0; counter < perfCount; ++counter) {
+                events[phase][counter] += record.events[phase][counter];
+            }
+        }
+    }
+
+    stream << boost::format("%-12s %12s") % "phase" % "seconds";
+    for (size_t counter = 0; counter < perfCount; ++counter) {
+        stream << boost::format(" %14s") % perf_group_t::name(perf_counter_t(counter));
+    }
+    stream << boost::format(" %8s %8s %8s %8s\n") % "ipc" % "l1d/ki" % "llc/ki" % "br/ki";
+
+    for (size_t phase = 0; phase < phaseCount; ++phase) {
+        if (seconds[phase] == 0) {
+            continue;
+        }
+        const perf_values_t &values = events[phase];
+        stream << boost::format("%-12s %12.6f") % c_phase_names[phase] % seconds[phase];
+        for (const uint64_t value: values) {
+            stream << boost::format(" %14d") % value;
+        }
+        const double cycles = values[perfCycles];
+        const double kilo = values[perfInstructions]/1000.;
+        stream << boost::format(" %8.3f %8.3f %8.3f %8.3f\n")
+                  % (cycles > 0 ? values[perfInstructions]/cycles : 0)
+                  % (kilo > 0 ? values[perfL1Misses]/kilo : 0)
+                  % (kilo > 0 ? values[perfLLCMisses]/kilo : 0)
+                  % (kilo > 0 ? values[perfBranchMisses]/kilo : 0);
+    }
+}
@@ -0,0 +1,325 @@
+/***************************************************************************************
+ * Copyright (c) 2014 Robert Riemann <robert@riemann.cc>                                *
+ *                                                                                      *
+ * This program is free software; you can redistribute it and/or modify it under        *
+ * the terms of the GNU General Public License as published by the Free Software        *
+ * Foundation; either version 2 of the License, or (at your option) any later           *
+ * version.                                                                             *
+ *                                                                                      *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY      *
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A      *
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.             *
+ *                                                                                      *
+ * You should have received a copy of the GNU General Public License along with         *
+ * this program.  If not, see <http://www.gnu.org/licenses/>.                           *
+ ****************************************************************************************/
+/*! \file instrument.hpp
+
+    \author Robert Riemann (robert@riemann.cc)
+
+    \brief optional instrumentation of the time steps
+
+    With the define INSTRUMENT, the grids record for every time step the wall
+    time of its phases, the number of leaves, the calls of node_t::branch(),
+    node_t::debranch() and node_t::getNeighbour() and the time every thread
+    worked in the parallel loops of the sweeps and of the remesh analysis.
+    setCounters() adds the hardware counters of perf.hpp to these loops, they
+    are read by every thread at its start and end. Without the define,
+    instrument_t has no members and its functions are empty, so the calls in
+    the grids compile to nothing.
+ */
+
+#ifndef INSTRUMENT_HPP
+#define INSTRUMENT_HPP
+
+#include <array>
+#include <vector>
+#include <iosfwd>
+#ifdef INSTRUMENT
+#include <chrono>
+#endif
+
+#include "settings.h"
+#include "perf.hpp"
+
+/*!
+   \brief enumerates the phases of the time steps which are timed
+ */
+enum instrument_phase_t {
+      phaseSweep = 0   //!< monores_grid_t::timeStepDirection(), flux and update in one pass
+    , phaseTiles       //!< monores_grid_t::timeStepsTiled()
+    , phaseFlow        //!< flux loop of multires_grid_t::sweep()
+    , phaseUpdate      //!< update loop of multires_grid_t::sweep()
+    , phaseAnalyse     //!< multires_grid_t::remeshAnalyse()
+    , phaseSavety      //!< multires_grid_t::remeshSavety()
+    , phaseClean       //!< multires_grid_t::remeshClean()
+    , phaseTopology    //!< multires_grid_t::updateTopology()
+    , phaseIncremental //!< multires_grid_t::remeshIncremental()
+    , phaseCount       //!< number of phases
+};
+
+/*!
+   \brief enumerates the events which are counted
+ */
+enum instrument_counter_t {
+      counterBranch = 0 //!< node_t::branch() creating children
+    , counterDebranch   //!< node_t::debranch()
+    , counterNeighbour  //!< node_t::getNeighbour() including the recursive calls, made by node_t::branch()
+    , counterCount      //!< number of counters
+};
+
+/*!
+   \brief The instrument_record_t struct holds the measurements of a time step
+ */
+struct instrument_record_t {
+    size_t step;   //!< grid_t::getSteps() after the time step
+    size_t steps;  //!< number of time steps covered, more than 1 for the fused steps of monores_grid_t::timeSteps()
+    double time;   //!< grid_t::getTime() after the time step
+    size_t leaves; //!< number of leaves or cells after the time step
+    std::array<double, phaseCount> seconds; //!< wall time per phase
+    std::array<size_t, counterCount> counts; //!< events per counter
+    std::vector<double> busy; //!< seconds each thread worked in the parallel loops
+    std::array<perf_values_t, phaseCount> events; //!< hardware counters per phase added up over the threads, see instrument_t::setCounters()
+};
+
+/*!
+   \brief The instrument_t class records a time series of instrument_record_t
+
+   The grids call startStep() and stopStep() around every time step,
+   startPhase() and stopPhase() around the phases outside of parallel regions
+   or on the master thread, count() from any thread, and every thread of a
+   parallel loop calls startThread() and stopThread() around its part.
+ */
+class instrument_t
+{
+public:
+    //! true if the define INSTRUMENT is set
+#ifdef INSTRUMENT
+    static constexpr bool c_enabled = true;
+#else
+    static constexpr bool c_enabled = false;
+#endif
+
+    //! seconds of a steady clock, 0 if disabled
+    double now() const
+    {
+#ifdef INSTRUMENT
+        return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#else
+        return 0;
+#endif
+    }
+
+    //! starts a record, the events since the last record are dropped
+    void startStep()
+    {
+#ifdef INSTRUMENT
+        m_current = instrument_record_t();
+        m_slots.assign(maxThreads(), slot_t());
+#endif
+    }
+
+    //! starts timing a phase, the times of repeated phases are summed up
+    void startPhase(const instrument_phase_t phase)
+    {
+#ifdef INSTRUMENT
+        m_phase = phase;
+        m_phase_start = now();
+#else
+        (void)phase;
+#endif
+    }
+
+    //! stops timing the phase of startPhase()
+    void stopPhase()
+    {
+#ifdef INSTRUMENT
+        m_current.seconds[m_phase] += now() - m_phase_start;
+#endif
+    }
+
+    /*!
+       \brief setCounters opens or closes the hardware counters of all OpenMP threads
+
+       It has to be called outside of parallel regions, see perf_team_t.
+
+       \return false if the counters are not available or INSTRUMENT is not defined
+     */
+    bool setCounters(const bool enable)
+    {
+#ifdef INSTRUMENT
+        m_team = perf_team_t();
+        return enable && m_team.open();
+#else
+        (void)enable;
+        return false;
+#endif
+    }
+
+    /*!
+       \brief The thread_sample_t struct is the state of a thread when it starts its part of a parallel loop
+     */
+    struct thread_sample_t {
+#ifdef INSTRUMENT
+        double seconds;
+        perf_values_t values;
+#endif
+    };
+
+    //! samples the clock and the hardware counters of the calling thread
+    thread_sample_t startThread()
+    {
+        thread_sample_t sample;
+#ifdef INSTRUMENT
+        const size_t thread = threadNumber();
+        if (thread < m_team.size()) {
+            m_team.group(thread).read(sample.values);
+        } else {
+            sample.values.fill(0);
+        }
+        sample.seconds = now();
+#endif
+        return sample;
+    }
+
+    //! adds the time and the events since start to the calling thread
+    void stopThread(const instrument_phase_t phase, const thread_sample_t &start)
+    {
+#ifdef INSTRUMENT
+        const double seconds = now();
+        const size_t thread = threadNumber();
+        if (thread < m_slots.size()) {
+            slot_t &slot = m_slots[thread];
+            slot.busy += seconds - start.seconds;
+            if (thread < m_team.size()) {
+                perf_values_t values;
+                m_team.group(thread).read(values);
+                const perf_values_t events = perfDifference(values, start.values);
+                for (size_t counter = 0; counter < perfCount; ++counter) {
+                    slot.events[phase][counter] += events[counter];
+                }
+            }
+        }
+#else
+        (void)phase;
+        (void)start;
+#endif
+    }
+
+    //! counts events of the calling thread
+    void count(const instrument_counter_t counter, const size_t events = 1)
+    {
+#ifdef INSTRUMENT
+        const size_t thread = threadNumber();
+        if (thread < m_slots.size()) {
+            m_slots[thread].counts[counter] += events;
+        }
+#else
+        (void)counter;
+        (void)events;
+#endif
+    }
+
+    /*!
+       \brief stopStep completes the record and appends it to records()
+       \param step number of time steps done, see grid_t::getSteps()
+       \param steps number of time steps since startStep()
+       \param time simulated time, see grid_t::getTime()
+       \param leaves number of leaves or cells
+     */
+    void stopStep(const size_t step, const size_t steps, const double time, const size_t leaves)
+    {
+#ifdef INSTRUMENT
+        m_current.step   = step;
+        m_current.steps  = steps;
+        m_current.time   = time;
+        m_current.leaves = leaves;
+        m_current.busy.resize(m_slots.size());
+        for (size_t i = 0; i < m_slots.size(); ++i) {
+            m_current.busy[i] = m_slots[i].busy;
+            for (size_t counter = 0; counter < counterCount; ++counter) {
+                m_current.counts[counter] += m_slots[i].counts[counter];
+            }
+            for (size_t phase = 0; phase < phaseCount; ++phase) {
+                for (size_t counter = 0; counter < perfCount; ++counter) {
+                    m_current.events[phase][counter] += m_slots[i].events[phase][counter];
+                }
+            }
+        }
+        m_records.push_back(m_current);
+#else
+        (void)step; (void)steps; (void)time; (void)leaves;
+#endif
+    }
+
+    //! the records of all time steps, empty if disabled
+    const std::vector<instrument_record_t> &records() const
+    { return m_records; }
+
+    //! drops the records
+    void clear()
+    {
+#ifdef INSTRUMENT
+        m_records.clear();
+#endif
+    }
+
+    /*!
+       \brief write writes the records as comma separated values with a header line
+
+       The columns are step, steps, time, leaves, the seconds per phase, the
+       events per counter, the busy time of the threads as minimum, maximum
+       and sum and the hardware counters added up over the phases.
+     */
+    void write(std::ostream &stream) const;
+
+    /*!
+       \brief summary writes a table of the seconds and hardware counters per phase added up over all records
+
+       Next to the counters it gives the instructions per cycle and the misses
+       and mispredicted branches per thousand instructions.
+     */
+    void summary(std::ostream &stream) const;
+
+private:
+#ifdef INSTRUMENT
+    /*!
+       \brief The slot_t struct holds the events of a thread, padded to multiples of a cache line
+     */
+    struct slot_t {
+        std::array<size_t, counterCount> counts{};
+        double busy = 0;
+        std::array<perf_values_t, phaseCount> events{};
+        char padding[64 - (sizeof(counts) + sizeof(busy) + sizeof(events)) % 64];
+    };
+
+    static size_t threadNumber()
+    {
+        #ifdef _OPENMP
+        return omp_get_thread_num();
+        #else
+        return 0;
+        #endif
+    }
+
+    static size_t maxThreads()
+    {
+        #ifdef _OPENMP
+        return omp_get_max_threads();
+        #else
+        return 1;
+        #endif
+    }
+
+    instrument_record_t m_current{};
+    instrument_phase_t m_phase = phaseSweep;
+    double m_phase_start = 0;
+    std::vector<slot_t> m_slots = std::vector<slot_t>(maxThreads());
+    perf_team_t m_team; //!< hardware counters, see setCounters()
+    std::vector<instrument_record_t> m_records;
+#else
+    static const std::vector<instrument_record_t> m_records; //!< always empty
+#endif
+};
+
+#endif // INSTRUMENT_HPP
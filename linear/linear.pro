@@ -0,0 +1,18 @@
+TEMPLATE = lib
+
+TARGET   = linear
+VERSION  = 0.1.0
+
+include(../common.pri)
+
+CONFIG += console
+CONFIG -= app_bundle
+CONFIG -= qt
+
+CONFIG += staticlib
+
+SOURCES += \
+    linear_grid.cpp
+
+HEADERS += \
+    linear_grid.hpp
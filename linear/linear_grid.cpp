@@ -0,0 +1,455 @@
+/***************************************************************************************
+ * Copyright (c) 2014 Robert Riemann <robert@riemann.cc>                                *
+ *                                                                                      *
+ * This program is free software; you can redistribute it and/or modify it under        *
+ * the terms of the GNU General Public License as published by the Free Software        *
+ * Foundation; either version 2 of the License, or (at your option) any later           *
+ * version.                                                                             *
+ *                                                                                      *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY      *
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A      *
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.             *
+ *                                                                                      *
+ * You should have received a copy of the GNU General Public License along with         *
+ * this program.  If not, see <http://www.gnu.org/licenses/>.                           *
+ ****************************************************************************************/
+
+#include <iostream>
+#include <algorithm>
+
+#include "linear_grid.hpp"
+
+constexpr size_t linear_grid_t::c_none;
+
+linear_grid_t::linear_grid_t(const u_char level_max, const u_char level_min, real epsilon,
+                             const field_generator_t &f_eval)
+    : linear_grid_t(level_max, level_min, epsilon, f_eval, nullptr)
+{
+}
+
+linear_grid_t::linear_grid_t(const snapshot_reader_t &checkpoint, const u_char level_min, real epsilon)
+    : linear_grid_t(checkpoint.header().level, level_min, epsilon, g_f_eval, &checkpoint)
+{
+}
+
+linear_grid_t::linear_grid_t(const u_char level_max, const u_char level_min, real epsilon,
+                             const field_generator_t &f_eval, const snapshot_reader_t *checkpoint)
+    : grid_t(f_eval)
+    , m_level_max(level_max)
+    , m_level_min(level_min)
+    , m_level_start((level_max+level_min)/2)
+    , m_epsilon(epsilon)
+    , dt(g_cfl*g_span[dimX]/((1 << level_max)*g_velocity))
+{
+    assert(m_level_max < g_morton_bits);
+    for (u_char dim = 0; dim < g_dimension; ++dim) {
+        m_mask[dim] = morton_mask(dim, m_level_max);
+    }
+
+    if (checkpoint) {
+        // the keys of the checkpoint are sorted like m_keys
+        assert(checkpoint->header().layout == layoutLeaves);
+        m_keys = checkpoint->keys();
+        m_levels = checkpoint->levels();
+        const field_vector &phi = checkpoint->phi();
+        const size_t count = m_keys.size();
+        m_points.resize(count);
+        #pragma omp parallel for schedule(static)
+        for (size_t i = 0; i < count; ++i) {
+            m_points[i] = point_t(morton_decode(m_keys[i]), m_level_max, phi[i]);
+        }
+        relink();
+        m_time = checkpoint->header().time;
+        m_steps = checkpoint->header().step;
+        return;
+    }
+
+    // regular grid on level_start, on this level the Morton key is just the counter
+    const size_t count = size_t(1) << (g_dimension*m_level_start);
+    m_keys.resize(count);
+    m_levels.assign(count, m_level_start);
+    m_points.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        m_keys[i] = morton_t(i) << (g_dimension*(m_level_max-m_level_start));
+        m_points[i] = point_t(morton_decode(m_keys[i]), m_level_max);
+    }
+    relink();
+
+    // initialize data points and optimize mesh
+    size_t size_new = size();
+    size_t size_old;
+    do {
+        size_old = size_new;
+        initializePoints();
+        remesh();
+        size_new = size();
+        std::cerr << "initalizing: " << size_old << " -> " << size_new << std::endl;
+    } while (size_old != size_new);
+}
+
+real linear_grid_t::interpolation(const ref_t &ref) const
+{
+    real phi = point(ref).m_phi;
+    for (u_char pos = 1; pos < g_childs; ++pos) {
+        ref_t inter = ref;
+        for (u_char dim = 0; dim < g_dimension; ++dim) {
+            if (pos & (1 << dim)) {
+                inter = neighbour(inter, dim, true);
+            }
+        }
+        phi += point(inter).m_phi;
+    }
+    return phi/g_childs;
+}
+
+real linear_grid_t::childPhi(const ref_t &ref, const u_char position) const
+{
+    if (position == 0) {
+        return point(ref).m_phi;
+    }
+    if (position == g_childs-1) {
+        return interpolation(ref);
+    }
+    ref_t inter = ref;
+    for (u_char dim = 0; dim < g_dimension; ++dim) {
+        if (position & (1 << dim)) {
+            inter = neighbour(inter, dim, true);
+        }
+    }
+    return (point(ref).m_phi + point(inter).m_phi)/2;
+}
+
+void linear_grid_t::updateFlow(const u_char dim)
+{
+    if (g_limiter) {
+        updateFlow<true>(dim);
+    } else {
+        updateFlow<false>(dim);
+    }
+}
+
+template<bool limiter>
+void linear_grid_t::updateFlow(const u_char dim)
+{
+    const real span = g_span[dim];
+    #pragma omp parallel for
+    for (size_t i = 0; i < m_keys.size(); ++i) {
+        const real phi_this = m_points[i].m_phi;
+
+        std::array<real, 2> phi_neighbour;
+        for (u_char up = 0; up < 2; ++up) {
+            const link_t &link = m_links[i][2*dim+up];
+            real phi = m_points[link.leaf].m_phi;
+            if (link.kind == link_t::linkCoarser) {
+                // interpolate the coarser neighbour
+                phi = (phi+phi_this)/2;
+            } else if (link.kind == link_t::linkFiner) {
+                // the neighbour is finer, extrapolate like node_t::updateFlow()
+                phi = m_points[link.source].m_phi;
+                phi = 2*phi-phi_this;
+            }
+            phi_neighbour[up] = phi;
+        }
+
+        const real dx = span/(1 << m_levels[i]);
+        m_points[i].m_flow = flowHelper<limiter>(phi_this, phi_neighbour[0], phi_neighbour[1], dx, dt);
+    }
+}
+
+void linear_grid_t::timeStep(const u_char dim)
+{
+    const real span = g_span[dim];
+    #pragma omp parallel for
+    for (size_t i = 0; i < m_keys.size(); ++i) {
+        const real flow_income = m_points[m_links[i][2*dim].leaf].m_flow;
+        const real dx = span/(1 << m_levels[i]);
+        m_points[i].m_phi += timeStepHelperFlow(m_points[i].m_flow, flow_income, dx, dt);
+    }
+}
+
+real linear_grid_t::timeStep()
+{
+    if (m_steps % 2 == 0) {
+        for (u_char dim = 0; dim < g_dimension; ++dim) {
+            updateFlow(dim);
+            timeStep(dim);
+        }
+    } else {
+        for (u_char dim = g_dimension; dim-- > 0;) {
+            updateFlow(dim);
+            timeStep(dim);
+        }
+    }
+    ++m_steps;
+
+    remesh();
+
+    m_time += dt;
+    return dt;
+}
+
+void linear_grid_t::remesh()
+{
+    enum {
+          fActive    = 1 << 0 // see node_t::flActive
+        , fBranch    = 1 << 1 // children get children with node_t::flSavetyZone
+        , fKeep      = 1 << 2 // node keeps its children
+        , fDeletable = 1 << 3 // return value of node_t::remesh_clean()
+    };
+
+    // flags of all existing nodes, indexed like m_nodes
+    std::vector<std::vector<u_char>> flags(m_level_max+1);
+    for (u_char level = 0; level <= m_level_max; ++level) {
+        flags[level].assign(m_nodes[level].size(), 0);
+    }
+
+    auto hasActiveChild = [&](const ref_t &ref) -> bool {
+        for (u_char pos = 0; pos < g_childs; ++pos) {
+            if (flags[ref.level+1][node(ref).childs + pos] & fActive) {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    // analyse, see node_t::remesh_analyse()
+    for (int level = m_level_max; level >= 0; --level) {
+        #pragma omp parallel for
+        for (size_t i = 0; i < m_nodes[level].size(); ++i) {
+            const ref_t ref = {u_char(level), i};
+            bool active = hasChilds(ref) && hasActiveChild(ref);
+
+            // respect minimum level
+            if (level <= m_level_min) {
+                active = true;
+            }
+
+            // check the residual of this node
+            if (!active && level > 0 && position({node(ref).key, u_char(level)}) == g_childs-1) {
+                active = fabs(point(ref).m_phi - interpolation(parent(ref))) > m_epsilon;
+            }
+
+            // check neighbours to keep the tree graded
+            for (u_char dim = 0; dim < g_dimension && !active; ++dim) {
+                for (u_char up = 0; up < 2 && !active; ++up) {
+                    const ref_t neighbour_ref = neighbour(ref, dim, up);
+                    active = (neighbour_ref.level == level) && hasChilds(neighbour_ref)
+                            && hasActiveChild(neighbour_ref);
+                }
+            }
+
+            flags[level][i] = active ? fActive : 0;
+        }
+    }
+
+    // savety zone, see node_t::remesh_savety()
+    for (u_char level = 0; level+1 < m_level_max; ++level) {
+        #pragma omp parallel for
+        for (size_t i = 0; i < m_nodes[level].size(); ++i) {
+            const ref_t ref = {level, i};
+            if (hasChilds(ref) && hasActiveChild(ref)) {
+                for (u_char pos = 0; pos < g_childs; ++pos) {
+                    flags[level+1][node(ref).childs + pos] |= fBranch;
+                }
+            }
+        }
+    }
+
+    // clean, see node_t::remesh_clean()
+    for (int level = m_level_max; level >= 0; --level) {
+        #pragma omp parallel for
+        for (size_t i = 0; i < m_nodes[level].size(); ++i) {
+            const ref_t ref = {u_char(level), i};
+            u_char &flag = flags[level][i];
+
+            bool keep = flag & fBranch;
+            if (!keep && hasChilds(ref)) {
+                for (u_char pos = 0; pos < g_childs; ++pos) {
+                    if (!(flags[level+1][node(ref).childs + pos] & fDeletable)) {
+                        keep = true;
+                    }
+                }
+            }
+            const bool savety = level > 0 && (flags[level-1][node(ref).parent] & fBranch);
+
+            if (keep) {
+                flag |= fKeep;
+            } else if (!(flag & fActive) && !savety) {
+                flag |= fDeletable;
+            }
+        }
+    }
+
+    // collect the leaves of the new tree in Morton order, new nodes have no position
+    struct entry_t {
+        cell_t cell;
+        size_t index;
+    };
+    std::vector<morton_t> keys;
+    std::vector<u_char> levels;
+    keys.reserve(m_keys.size());
+    levels.reserve(m_keys.size());
+    std::vector<entry_t> stack(1, {{0, 0}, 0}); // root
+    while (!stack.empty()) {
+        const entry_t entry = stack.back();
+        stack.pop_back();
+
+        const cell_t &cell = entry.cell;
+        if (entry.index != c_none && (flags[cell.level][entry.index] & fKeep)) {
+            const size_t childs = m_nodes[cell.level][entry.index].childs;
+            for (short pos = g_childs-1; pos >= 0; --pos) {
+                stack.push_back({child(cell, pos), childs == c_none ? c_none : childs+pos});
+            }
+        } else {
+            keys.push_back(cell.key);
+            levels.push_back(cell.level);
+        }
+    }
+
+    // keep the tables if the leaves did not change
+    if (keys != m_keys || levels != m_levels) {
+        refine(keys, levels);
+    }
+}
+
+void linear_grid_t::refine(const std::vector<morton_t> &keys, const std::vector<u_char> &levels)
+{
+    // the old leaf covering every new leaf, both are sorted
+    std::vector<size_t> covers(keys.size());
+    size_t leaf = 0;
+    for (size_t i = 0; i < keys.size(); ++i) {
+        while (leaf+1 < m_keys.size() && m_keys[leaf+1] <= keys[i]) {
+            ++leaf;
+        }
+        covers[i] = leaf;
+    }
+
+    std::vector<point_t> points(keys.size());
+    #pragma omp parallel for
+    for (size_t i = 0; i < keys.size(); ++i) {
+        const size_t leaf = covers[i];
+        if (m_keys[leaf] == keys[i]) {
+            // the point of the first child is the point of its parent
+            points[i] = m_points[leaf];
+        } else {
+            assert(m_levels[leaf]+1 == levels[i]);
+            const ref_t parent = {m_levels[leaf], m_leaf_nodes[leaf]};
+            points[i] = point_t(morton_decode(keys[i]), m_level_max,
+                                childPhi(parent, position({keys[i], levels[i]})));
+            points[i].m_flow = 0;
+        }
+    }
+
+    m_keys = keys;
+    m_levels = levels;
+    m_points.swap(points);
+    relink();
+}
+
+void linear_grid_t::unfold(u_char level_max)
+{
+    bool finished;
+    do {
+        finished = true;
+        std::vector<morton_t> keys;
+        std::vector<u_char> levels;
+        for (size_t i = 0; i < m_keys.size(); ++i) {
+            const cell_t cell = {m_keys[i], m_levels[i]};
+            if (cell.level < level_max) {
+                for (u_char pos = 0; pos < g_childs; ++pos) {
+                    keys.push_back(child(cell, pos).key);
+                    levels.push_back(cell.level+1);
+                }
+                finished = false;
+            } else {
+                keys.push_back(cell.key);
+                levels.push_back(cell.level);
+            }
+        }
+        if (!finished) {
+            refine(keys, levels);
+        }
+    } while (!finished);
+}
+
+void linear_grid_t::relink()
+{
+    m_point_index.resize(m_points.size());
+    for (size_t i = 0; i < m_points.size(); ++i) {
+        m_point_index[i] = &m_points[i];
+    }
+
+    // a leaf starts the nodes from the coarsest level its key is a corner of down to itself
+    m_nodes.resize(m_level_max+1);
+    for (std::vector<tree_node_t> &nodes: m_nodes) {
+        nodes.clear();
+    }
+    m_leaf_nodes.resize(m_keys.size());
+    for (size_t i = 0; i < m_keys.size(); ++i) {
+        const morton_t key = m_keys[i];
+        u_char level = m_levels[i];
+        while (level > 0 && (key & morton_level_mask(m_level_max-level+1)) == key) {
+            --level;
+        }
+        for (; level <= m_levels[i]; ++level) {
+            tree_node_t node;
+            node.key = key;
+            node.point = i;
+            node.parent = (level > 0) ? m_nodes[level-1].size()-1 : c_none;
+            node.childs = (level < m_levels[i]) ? m_nodes[level+1].size() : c_none;
+            m_nodes[level].push_back(node);
+        }
+        m_leaf_nodes[i] = m_nodes[m_levels[i]].size()-1;
+    }
+
+    // the neighbours of a node are its siblings or children of the neighbours of its parent
+    m_nodes[0][0].neighbours.fill({0, 0}); // periodic boundaries
+    for (u_char level = 1; level <= m_level_max; ++level) {
+        std::vector<tree_node_t> &nodes = m_nodes[level];
+        #pragma omp parallel for
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            const tree_node_t &parent = m_nodes[level-1][nodes[i].parent];
+            const u_char pos = i - parent.childs;
+            for (u_char dim = 0; dim < g_dimension; ++dim) {
+                const u_char bit = 1 << dim;
+                for (u_char up = 0; up < 2; ++up) {
+                    ref_t &neighbour = nodes[i].neighbours[2*dim+up];
+                    if (bool(pos & bit) != bool(up)) {
+                        neighbour = {level, parent.childs + (pos ^ bit)};
+                    } else {
+                        const ref_t &uncle = parent.neighbours[2*dim+up];
+                        if (uncle.level+1 == level && hasChilds(uncle)) {
+                            neighbour = child(uncle, pos ^ bit);
+                        } else {
+                            // the coarser leaf covering the neighbour
+                            neighbour = uncle;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    // neighbours of the leaves for updateFlow() and timeStep()
+    m_links.resize(m_keys.size());
+    #pragma omp parallel for
+    for (size_t i = 0; i < m_keys.size(); ++i) {
+        const ref_t ref = {m_levels[i], m_leaf_nodes[i]};
+        for (u_char dim = 0; dim < g_dimension; ++dim) {
+            for (u_char up = 0; up < 2; ++up) {
+                const ref_t neighbour_ref = neighbour(ref, dim, up);
+                link_t &link = m_links[i][2*dim+up];
+                link.leaf = node(neighbour_ref).point;
+                link.source = link.leaf;
+                if (neighbour_ref.level < ref.level) {
+                    link.kind = link_t::linkCoarser;
+                } else if (hasChilds(neighbour_ref) && dim == dimX) {
+                    link.kind = link_t::linkFiner;
+                    link.source = node(child(neighbour_ref, g_childs-1)).point;
+                } else {
+                    link.kind = link_t::linkSame;
+                }
+            }
+        }
+    }
+}
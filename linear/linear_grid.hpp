@@ -0,0 +1,241 @@
+/***************************************************************************************
+ * Copyright (c) 2014 Robert Riemann <robert@riemann.cc>                                *
+ *                                                                                      *
+ * This program is free software; you can redistribute it and/or modify it under        *
+ * the terms of the GNU General Public License as published by the Free Software        *
+ * Foundation; either version 2 of the License, or (at your option) any later           *
+ * version.                                                                             *
+ *                                                                                      *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY      *
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A      *
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.             *
+ *                                                                                      *
+ * You should have received a copy of the GNU General Public License along with         *
+ * this program.  If not, see <http://www.gnu.org/licenses/>.                           *
+ ****************************************************************************************/
+
+#ifndef LINEAR_GRID_HPP
+#define LINEAR_GRID_HPP
+
+#include <array>
+#include <vector>
+
+#include "settings.h"
+#include "morton.hpp"
+#include "grid.hpp"
+#include "snapshot.hpp"
+#include "point.hpp"
+
+/*!
+   \brief The linear_grid_t class implements the multi resolution grid as a linear tree
+
+   Instead of linking node_t objects by pointers, only the leaves of the tree
+   are stored. They are kept in arrays sorted by the Morton key of their lower
+   left corner evaluated on the finest level. As the leaves tile the domain,
+   the leaf covering a position is the one with the largest key not greater
+   than the key of the position. Inner nodes are implicit: a node of level `l`
+   exists if the leaf at its corner has at least level `l`.
+
+   Whenever the leaves change, relink() derives the nodes of all levels from
+   the keys in one pass and tabulates their neighbours, so neither the time
+   steps nor the next remesh() have to search the keys.
+
+   The numerical scheme, the thresholding and the savety zone follow
+   multires_grid_t, so both backends can be exchanged.
+ */
+class linear_grid_t : public grid_t
+{
+public:
+    /*!
+       \brief linear_grid_t sets up a multi resolution grid stored as linear tree
+       \param level_max finest level of this grid
+       \param level_min coarsest level of this grid
+       \param epsilon threshold value to dismiss nodes
+       \param f_eval initializer of the field
+     */
+    linear_grid_t(const u_char level_max, const u_char level_min = 0, real epsilon = g_epsilon,
+                  const field_generator_t &f_eval = g_f_eval);
+
+    /*!
+       \brief linear_grid_t restores a grid from a checkpoint, see multires_grid_t
+       \param checkpoint record of \ref layoutLeaves, its leaves are taken as they are
+       \param level_min coarsest level of this grid
+       \param epsilon threshold value to dismiss nodes
+     */
+    linear_grid_t(const snapshot_reader_t &checkpoint, const u_char level_min = 0, real epsilon = g_epsilon);
+
+    virtual real timeStep(); // documented in grid_t
+
+    void unfold(u_char level_max); //!< refines all leaves up to level_max to get a regular grid
+
+    virtual void getCellLevels(std::vector<u_char> &levels) // documented in grid_t
+    { levels = m_levels; }
+
+    virtual size_t size()
+    { return m_keys.size(); }
+
+    virtual ~linear_grid_t() {}
+
+private:
+    linear_grid_t(const linear_grid_t&) = delete; // remove copy constructor
+
+    //! sets up the grid and takes the leaves from checkpoint unless it is nullptr
+    linear_grid_t(const u_char level_max, const u_char level_min, real epsilon, const field_generator_t &f_eval,
+                  const snapshot_reader_t *checkpoint);
+
+    /*!
+       \brief The cell_t struct identifies a node of the implicit tree
+     */
+    struct cell_t {
+        morton_t key; //!< Morton key of the lower left corner on the finest level
+        u_char level; //!< level of the node
+    };
+
+    /*!
+       \brief The ref_t struct refers to an existing node by its position in \ref m_nodes
+     */
+    struct ref_t {
+        u_char level; //!< level of the node
+        size_t index; //!< position of the node on its level
+    };
+
+    static constexpr size_t c_none = size_t(-1); //!< position of a node which does not exist
+
+    /*!
+       \brief The tree_node_t struct is an existing node of the implicit tree
+     */
+    struct tree_node_t {
+        morton_t key;  //!< Morton key of the lower left corner on the finest level
+        size_t point;  //!< leaf at the corner, it holds the point of the node
+        size_t parent; //!< position of the parent on the next coarser level
+        size_t childs; //!< position of the first child on the next finer level, \ref c_none for leaves
+        std::array<ref_t, 2*g_dimension> neighbours; //!< see neighbour(), indexed by 2*dim+up
+    };
+
+    /*!
+       \brief The link_t struct is the neighbour of a leaf in one direction as used by the time steps
+     */
+    struct link_t {
+        enum kind_t {
+              linkSame    //!< the neighbour is a leaf of the same level
+            , linkCoarser //!< the neighbour is a coarser leaf and gets interpolated
+            , linkFiner   //!< the neighbour has children and gets extrapolated from source
+        };
+        size_t leaf;   //!< leaf at the corner of the neighbour
+        size_t source; //!< leaf at the far corner of a finer neighbour along dimX, otherwise leaf
+        kind_t kind;
+    };
+
+    const u_char m_level_max; //!< maximum level, finest grid
+    const u_char m_level_min; //!< minimum level, coarsest grid
+    const u_char m_level_start; //!< level to start with at initialization
+    const real m_epsilon; //!< threshold value to dismiss nodes, see \ref g_epsilon
+    const real dt; //!< global time step
+    std::array<morton_t, g_dimension> m_mask; //!< bits of a key per dimension, see morton_mask()
+
+    std::vector<morton_t> m_keys; //!< sorted keys of all leaves
+    std::vector<u_char> m_levels; //!< level of every leaf
+    std::vector<point_t> m_points; //!< point of every leaf, i.e. of its lower left corner
+
+    std::vector<std::vector<tree_node_t>> m_nodes; //!< existing nodes per level in Morton order, see relink()
+    std::vector<size_t> m_leaf_nodes; //!< position of every leaf in \ref m_nodes on its level
+    std::vector<std::array<link_t, 2*g_dimension>> m_links; //!< neighbours of every leaf, indexed by 2*dim+up
+
+    /*!
+       \brief node gives an existing node
+     */
+    const tree_node_t &node(const ref_t &ref) const
+    { return m_nodes[ref.level][ref.index]; }
+
+    /*!
+       \brief neighbour gets the neighbour in one direction which has the same or a coarser level
+       \param ref existing node
+       \param dim dimension to move along
+       \param up true for the neighbour with larger index
+       \return the neighbouring node
+
+       This is the counterpart to node_t::getNeighbour().
+     */
+    ref_t neighbour(const ref_t &ref, const u_char dim, const bool up) const
+    { return node(ref).neighbours[2*dim+up]; }
+
+    /*!
+       \brief point gives the point of an existing node
+     */
+    const point_t &point(const ref_t &ref) const
+    { return m_points[node(ref).point]; }
+
+    /*!
+       \brief hasChilds is true if an existing node is not a leaf
+     */
+    bool hasChilds(const ref_t &ref) const
+    { return node(ref).childs != c_none; }
+
+    /*!
+       \brief child gives the child at position of an existing node which is not a leaf
+     */
+    ref_t child(const ref_t &ref, const u_char position) const
+    { return {u_char(ref.level+1), node(ref).childs + position}; }
+
+    /*!
+       \brief child gives the child at position of a node
+     */
+    cell_t child(const cell_t &cell, const u_char position) const
+    { return {cell.key | (morton_t(position) << ((m_level_max-cell.level-1)*g_dimension)), u_char(cell.level+1)}; }
+
+    /*!
+       \brief position gives the position of the node relative to its parent, see node_t::position_t
+     */
+    u_char position(const cell_t &cell) const
+    { return (cell.key >> ((m_level_max-cell.level)*g_dimension)) & (g_childs-1); }
+
+    /*!
+       \brief parent gives the parent of an existing node which is not the root
+     */
+    ref_t parent(const ref_t &ref) const
+    { return {u_char(ref.level-1), node(ref).parent}; }
+
+    /*!
+       \brief interpolation gives the field value in the center of an existing node, see node_t::interpolation()
+     */
+    real interpolation(const ref_t &ref) const;
+
+    /*!
+       \brief childPhi gives the initial field value of a new child of an existing leaf, see node_t::branch()
+     */
+    real childPhi(const ref_t &ref, const u_char position) const;
+
+    void updateFlow(const u_char dim); //!< see node_t::updateFlow(), dispatches by \ref g_limiter
+    template<bool limiter>
+    void updateFlow(const u_char dim);
+    void timeStep(const u_char dim); //!< see node_t::timeStep()
+
+    /*!
+       \brief remesh adopts the local granularity of the mesh
+
+       The three phases of multires_grid_t::remesh() are evaluated level by level
+       on the implicit inner nodes before the new leaves are written in one go.
+     */
+    void remesh();
+
+    /*!
+       \brief refine replaces the leaves by new sets of leaves
+       \param keys of the new leaves in Morton order
+       \param levels of the new leaves
+
+       Leaves that start at the corner of an old leaf take over its point, all
+       others are children of an old leaf and are interpolated from the old leaves.
+     */
+    void refine(const std::vector<morton_t> &keys, const std::vector<u_char> &levels);
+
+    /*!
+       \brief relink updates grid_t::m_point_index, \ref m_nodes and \ref m_links after the leaves have changed
+
+       The nodes are collected in one pass over the leaves, as a leaf starts all
+       nodes whose lower left corner is its key. The neighbours follow level by
+       level from the neighbours of the parents.
+     */
+    void relink();
+};
+
+#endif // LINEAR_GRID_HPP
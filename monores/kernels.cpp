@@ -0,0 +1,251 @@
+/***************************************************************************************
+ * Copyright (c) 2014 Robert Riemann <robert@riemann.cc>                                *
+ *                                                                                      *
+ * This program is free software; you can redistribute it and/or modify it under        *
+ * the terms of the GNU General Public License as published by the Free Software        *
+ * Foundation; either version 2 of the License, or (at your option) any later           *
+ * version.                                                                             *
+ *                                                                                      *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY      *
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A      *
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.             *
+ *                                                                                      *
+ * You should have received a copy of the GNU General Public License along with         *
+ * this program.  If not, see <http://www.gnu.org/licenses/>.                           *
+ ****************************************************************************************/
+
+#include <cstring>
+
+#include "kernels.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define KERNELS_X86
+#define KERNEL_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+#define KERNEL_INLINE inline __attribute__((always_inline))
+
+namespace {
+
+/*!
+   \brief The vector_t struct defines vectors of the lanes processed at once by a kernel of bytes (gcc/clang extension)
+
+   The vectors of \ref real_field fill bytes, the vectors of \ref real have the
+   same number of lanes.
+ */
+template<unsigned bytes>
+struct vector_t {
+    static constexpr size_t lanes = bytes/sizeof(real_field);
+    typedef real_field field __attribute__((vector_size(lanes*sizeof(real_field))));
+    typedef real       type  __attribute__((vector_size(lanes*sizeof(real))));
+};
+
+/*!
+   \brief The convert_t struct converts vectors between \ref real_field and \ref real
+ */
+template<typename to, typename from>
+struct convert_t {
+    static KERNEL_INLINE void apply(to &v, const from &f)
+    { v = __builtin_convertvector(f, to); }
+};
+
+template<typename same>
+struct convert_t<same, same> {
+    static KERNEL_INLINE void apply(same &v, const same &f)
+    { v = f; }
+};
+
+// vectors are passed by reference, as their calling convention depends on the instruction set
+
+template<typename vector, typename scalar>
+KERNEL_INLINE void load(vector &v, const scalar *p)
+{
+    std::memcpy(&v, p, sizeof(vector)); // unaligned load
+}
+
+template<typename vector, typename scalar>
+KERNEL_INLINE void store(scalar *p, const vector &v)
+{
+    std::memcpy(p, &v, sizeof(vector)); // unaligned store
+}
+
+template<unsigned bytes>
+KERNEL_INLINE void loadField(typename vector_t<bytes>::type &v, const real_field *p)
+{
+    typename vector_t<bytes>::field f;
+    load(f, p);
+    convert_t<typename vector_t<bytes>::type, typename vector_t<bytes>::field>::apply(v, f);
+}
+
+/*
+   The kernels are inlined into functions compiled for the different instruction
+   sets. The vector code evaluates the same expressions as flowHelper() and
+   timeStepHelperFlow(), so all instruction sets give identical results.
+ */
+
+template<unsigned bytes, bool limiter>
+KERNEL_INLINE void flowKernel(const real_field *phi, const real_field *phi_left, const real_field *phi_right,
+                              real *flow, size_t n, real alpha)
+{
+    typedef typename vector_t<bytes>::type vreal;
+    constexpr size_t width = vector_t<bytes>::lanes;
+
+    size_t i = 0;
+    for (; i+width <= n; i += width) {
+        vreal ee, el, er, derivative;
+        loadField<bytes>(ee, phi+i);
+        loadField<bytes>(el, phi_left+i);
+        loadField<bytes>(er, phi_right+i);
+        if (limiter) {
+            // minmod(ee - el, er - ee)
+            const vreal a = ee - el;
+            const vreal b = er - ee;
+            const vreal abs_a = (a < 0) ? -a : a;
+            const vreal abs_b = (b < 0) ? -b : b;
+            derivative = (a*b > 0) ? ((abs_a < abs_b) ? a : b) : vreal{};
+        } else {
+            derivative = (er-el)/2;
+        }
+        const vreal f = ee + alpha*derivative;
+        store(flow+i, f);
+    }
+    for (; i < n; ++i) {
+        const real ee = phi[i];
+        const real el = phi_left[i];
+        const real er = phi_right[i];
+        const real derivative = limiter ? minmod(ee - el, er - ee) : (er-el)/2;
+        flow[i] = ee + alpha*derivative;
+    }
+}
+
+template<unsigned bytes>
+KERNEL_INLINE void updateKernel(real_field *phi, const real *flow, const real *flow_left, size_t n, real beta)
+{
+    typedef typename vector_t<bytes>::type vreal;
+    typedef typename vector_t<bytes>::field vfield;
+    constexpr size_t width = vector_t<bytes>::lanes;
+
+    size_t i = 0;
+    for (; i+width <= n; i += width) {
+        vreal p, f, fl;
+        loadField<bytes>(p, phi+i);
+        load(f, flow+i);
+        load(fl, flow_left+i);
+        p += beta*(f - fl);
+        vfield result;
+        convert_t<vfield, vreal>::apply(result, p);
+        store(phi+i, result);
+    }
+    for (; i < n; ++i) {
+        phi[i] += beta*(flow[i] - flow_left[i]);
+    }
+}
+
+// generic: baseline instruction set of the compiler
+
+void flowGeneric(const real_field *phi, const real_field *phi_left, const real_field *phi_right, real *flow, size_t n, real alpha)
+{ flowKernel<16, false>(phi, phi_left, phi_right, flow, n, alpha); }
+
+void flowLimitedGeneric(const real_field *phi, const real_field *phi_left, const real_field *phi_right, real *flow, size_t n, real alpha)
+{ flowKernel<16, true>(phi, phi_left, phi_right, flow, n, alpha); }
+
+void updateGeneric(real_field *phi, const real *flow, const real *flow_left, size_t n, real beta)
+{ updateKernel<16>(phi, flow, flow_left, n, beta); }
+
+const kernel_table_t tableGeneric = { flowGeneric, flowLimitedGeneric, updateGeneric,
+#ifdef KERNELS_X86
+                                      "sse2" };
+#else
+                                      "generic" };
+#endif
+
+#ifdef KERNELS_X86
+
+// AVX2
+
+KERNEL_TARGET("avx2")
+void flowAVX2(const real_field *phi, const real_field *phi_left, const real_field *phi_right, real *flow, size_t n, real alpha)
+{ flowKernel<32, false>(phi, phi_left, phi_right, flow, n, alpha); }
+
+KERNEL_TARGET("avx2")
+void flowLimitedAVX2(const real_field *phi, const real_field *phi_left, const real_field *phi_right, real *flow, size_t n, real alpha)
+{ flowKernel<32, true>(phi, phi_left, phi_right, flow, n, alpha); }
+
+KERNEL_TARGET("avx2")
+void updateAVX2(real_field *phi, const real *flow, const real *flow_left, size_t n, real beta)
+{ updateKernel<32>(phi, flow, flow_left, n, beta); }
+
+const kernel_table_t tableAVX2 = { flowAVX2, flowLimitedAVX2, updateAVX2, "avx2" };
+
+// AVX-512
+
+KERNEL_TARGET("avx512f")
+void flowAVX512(const real_field *phi, const real_field *phi_left, const real_field *phi_right, real *flow, size_t n, real alpha)
+{ flowKernel<64, false>(phi, phi_left, phi_right, flow, n, alpha); }
+
+KERNEL_TARGET("avx512f")
+void flowLimitedAVX512(const real_field *phi, const real_field *phi_left, const real_field *phi_right, real *flow, size_t n, real alpha)
+{ flowKernel<64, true>(phi, phi_left, phi_right, flow, n, alpha); }
+
+KERNEL_TARGET("avx512f")
+void updateAVX512(real_field *phi, const real *flow, const real *flow_left, size_t n, real beta)
+{ updateKernel<64>(phi, flow, flow_left, n, beta); }
+
+const kernel_table_t tableAVX512 = { flowAVX512, flowLimitedAVX512, updateAVX512, "avx512" };
+
+#endif // KERNELS_X86
+
+/*!
+   \brief supported checks if the processor supports an instruction set
+
+   The processor is queried by the first call only.
+ */
+bool supported(const isa_t isa)
+{
+#ifdef KERNELS_X86
+    static const bool avx512 = (__builtin_cpu_init(), __builtin_cpu_supports("avx512f"));
+    static const bool avx2   = __builtin_cpu_supports("avx2");
+    switch (isa) {
+    case isaAVX512:
+        return avx512;
+    case isaAVX2:
+        return avx2;
+    default:
+        return true;
+    }
+#else
+    return isa == isaGeneric;
+#endif
+}
+
+//! the kernels of a supported instruction set, the generic ones otherwise
+const kernel_table_t *table(const isa_t isa)
+{
+#ifdef KERNELS_X86
+    if (supported(isa)) {
+        switch (isa) {
+        case isaAVX512:
+            return &tableAVX512;
+        case isaAVX2:
+            return &tableAVX2;
+        default:
+            break;
+        }
+    }
+#endif
+    return &tableGeneric;
+}
+
+} // namespace
+
+const kernel_table_t &kernelTable(const isa_t isa)
+{
+    if (isa == isaAuto) {
+        // resolved once, the grids take the table on construction
+        static const kernel_table_t *const best = table(supported(isaAVX512) ? isaAVX512
+                                                      : supported(isaAVX2)   ? isaAVX2
+                                                                             : isaGeneric);
+        return *best;
+    }
+    return *table(isa);
+}
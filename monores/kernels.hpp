@@ -0,0 +1,105 @@
+/***************************************************************************************
+ * Copyright (c) 2014 Robert Riemann <robert@riemann.cc>                                *
+ *                                                                                      *
+ * This program is free software; you can redistribute it and/or modify it under        *
+ * the terms of the GNU General Public License as published by the Free Software        *
+ * Foundation; either version 2 of the License, or (at your option) any later           *
+ * version.                                                                             *
+ *                                                                                      *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY      *
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A      *
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.             *
+ *                                                                                      *
+ * You should have received a copy of the GNU General Public License along with         *
+ * this program.  If not, see <http://www.gnu.org/licenses/>.                           *
+ ****************************************************************************************/
+/*! \file kernels.hpp
+
+    \author Robert Riemann (robert@riemann.cc)
+
+    \brief vectorised row kernels of the regular grid
+
+    The kernels apply flowHelper() and timeStepHelperFlow() to a row of
+    consecutive cells. They are compiled for several instruction sets and the
+    best one supported by the processor is chosen at runtime. The field values
+    are read and written as \ref real_field, the fluxes are computed and kept
+    as \ref real.
+ */
+
+#ifndef KERNELS_HPP
+#define KERNELS_HPP
+
+#include "settings.h"
+
+/*!
+   \brief enumerates the instruction sets the kernels are compiled for
+ */
+enum isa_t {
+      isaGeneric = 0 //!< 16 byte vectors, i.e. SSE2 on x86-64
+    , isaAVX2        //!< 32 byte vectors
+    , isaAVX512      //!< 64 byte vectors
+    , isaAuto        //!< best instruction set supported by the processor
+};
+
+//! signature of the flux kernels of kernel_table_t
+typedef void (*flow_kernel_t)(const real_field *phi, const real_field *phi_left, const real_field *phi_right,
+                              real *flow, size_t n, real alpha);
+
+//! signature of the update kernels of kernel_table_t
+typedef void (*update_kernel_t)(real_field *phi, const real *flow, const real *flow_left, size_t n, real beta);
+
+/*!
+   \brief The kernel_table_t struct bundles the row kernels for one instruction set
+ */
+struct kernel_table_t {
+    /*!
+       \brief flow computes flowHelper() without limiter for n consecutive cells
+       \param phi field values of the cells
+       \param phi_left field values of the previous neighbours
+       \param phi_right field values of the next neighbours
+       \param flow receives the flux of the cells
+       \param n number of cells
+       \param alpha see flowCoefficient()
+     */
+    flow_kernel_t flow;
+
+    /*!
+       \brief flowLimited is the same as flow() but applies minmod() to the derivative, see \ref g_limiter
+     */
+    flow_kernel_t flowLimited;
+
+    /*!
+       \brief update adds timeStepHelperFlow() to n consecutive cells
+       \param phi field values of the cells to be updated
+       \param flow flux of the cells
+       \param flow_left flux of the previous neighbours
+       \param n number of cells
+       \param beta see timeStepCoefficient()
+     */
+    update_kernel_t update;
+
+    const char *name; //!< name of the instruction set
+};
+
+/*!
+   \brief kernelTable gives the kernels for an instruction set
+   \param isa instruction set, \ref isaAuto picks the best one supported by the processor
+   \return kernels
+
+   If the processor does not support isa, the generic kernels are returned.
+ */
+const kernel_table_t &kernelTable(isa_t isa = isaAuto);
+
+/*!
+   \brief flowCoefficient gives the factor of the derivative in flowHelper()
+ */
+inline real flowCoefficient(const real &dx, const real &dt)
+{ return 0.5*(1-dt/dx*g_velocity); }
+
+/*!
+   \brief timeStepCoefficient gives the factor of the flux difference in timeStepHelperFlow()
+ */
+inline real timeStepCoefficient(const real &dx, const real &dt)
+{ return - (dt/dx)*g_velocity; }
+
+#endif // KERNELS_HPP
@@ -5,6 +5,10 @@ VERSION  = 0.1.0
 
 include(../common.pri)
 
+# AVX-512 implies FMA; contracting the expressions of the kernels would make
+# the results depend on the instruction set
+QMAKE_CXXFLAGS += -ffp-contract=off
+
 CONFIG += console
 CONFIG -= app_bundle
 CONFIG -= qt
@@ -12,7 +16,9 @@ CONFIG -= qt
 CONFIG += staticlib
 
 SOURCES += \
-    monores_grid.cpp
+    monores_grid.cpp \
+    kernels.cpp
 
 HEADERS += \
-    monores_grid.hpp
+    monores_grid.hpp \
+    kernels.hpp
@@ -15,170 +15,405 @@
  ****************************************************************************************/
 
 #include <assert.h>
+#include <algorithm>
 
 #include "monores_grid.hpp"
 
-monores_grid_t::monores_grid_t(const u_char level_max) :
-    grid_t()
+const size_t monores_grid_t::c_strip_width;
+
+monores_grid_t::monores_grid_t(const u_char level_max, const field_generator_t &f_eval) :
+    monores_grid_t(level_max, f_eval, nullptr)
+{
+}
+
+monores_grid_t::monores_grid_t(const snapshot_reader_t &checkpoint) :
+    monores_grid_t(checkpoint.header().level, g_f_eval, &checkpoint)
+{
+}
+
+monores_grid_t::monores_grid_t(const u_char level_max, const field_generator_t &f_eval,
+                               const snapshot_reader_t *checkpoint) :
+    grid_t(f_eval)
   , N(1 << level_max)
-  , N2(N*N)
-  , dx({{g_span[dimX]/N, g_span[dimY]/N}})
-  , pointvector(std::vector<point_t>(N2))
+  , NN(size_t(1) << (g_dimension*level_max))
+  , dx(cellSize(level_max))
+  , m_phi(NN)
+  , pointvector(std::vector<point_t>(NN))
+  , m_points_valid(true)
+  , m_points_exposed(false)
+  , m_kernels(&kernelTable())
+  , m_tile_size(g_dimension < 3 ? 256 : 32)
+  , m_fused_steps(8)
 {
     // find smallest dt
-    real dt_x = g_cfl*dx[dimX]/g_velocity;
-    real dt_y = g_cfl*dx[dimY]/g_velocity;
-    dt = (dt_x < dt_y) ? dt_x : dt_y;
-
-    #pragma omp parallel for collapse(2)
-    for (size_t j = 0; j < N; ++j) { // y-direction
-        for (size_t i = 0; i < N; ++i) { // x-direction
-            assert(g_dimension == 2);
-            index_t index({{i, j}});
-            const point_t point(index, level_max, s_f_eval);
-            pointvector[N*j+i] = point;
+    dt = g_cfl*dx[dimX]/g_velocity;
+    for (u_char dim = 1; dim < g_dimension; ++dim) {
+        dt = std::min(dt, g_cfl*dx[dim]/g_velocity);
+    }
+
+    #pragma omp parallel for
+    for (size_t i = 0; i < NN; ++i) {
+        index_t index;
+        size_t rest = i;
+        for (u_char dim = 0; dim < g_dimension; ++dim) { // x-direction first
+            index[dim] = rest % N;
+            rest /= N;
         }
+        pointvector[i] = point_t(index, level_max);
     }
 
-    point_t *last = 0;
-    for (size_t i = 0; i < N2; ++i) {
-        point_t *p = &pointvector[i];
-        p->m_next = last;
-        last = p;
+    // the points are iterated from the last to the first one
+    m_point_index.resize(NN);
+    for (size_t i = 0; i < NN; ++i) {
+        m_point_index[i] = &pointvector[NN-1-i];
+    }
+
+    if (checkpoint) {
+        const bool valid = checkpoint->raster(level_max, m_phi);
+        assert(valid);
+        (void)valid;
+        m_time = checkpoint->header().time;
+        m_steps = checkpoint->header().step;
+        m_points_valid = false;
+    } else {
+        initializePoints();
+        updateArrays();
     }
 }
 
-void monores_grid_t::timeStepDirection(bool directionX)
+void monores_grid_t::timeStepDirection(const u_char dim)
 {
-    if (directionX) {
-        // direction X
-
-        // update inner cell values
-        #pragma omp parallel for collapse(2)
-        for (size_t j = 0; j < N; ++j) { // y-direction (full range)
-            for (size_t i = 1; i < N-1; ++i) { // x-direction (range w/o edges)
-                const size_t o = j*N; // offset
-                pointvector[o+i].m_flow = flowHelper(
-                            pointvector[o+i].m_phi,
-                        pointvector[o+i-1].m_phi,
-                        pointvector[o+i+1].m_phi,
-                        dx[dimX], dt);
+    real_field *phi = m_phi.data();
+
+    const flow_kernel_t flowRow = flowKernel();
+    const update_kernel_t updateRow = m_kernels->update;
+    const real alpha = flowCoefficient(dx[dim], dt);
+    const real beta  = timeStepCoefficient(dx[dim], dt);
+
+    if (dim == dimX) {
+        // direction X: the flux of a row is kept in a line buffer and applied
+        // right after its computation while the row is still in cache
+        const size_t rows = NN/N;
+
+        #pragma omp parallel
+        {
+            const instrument_t::thread_sample_t start = m_instrument.startThread();
+            real_vector line(N); // flux of one row
+            real *flow = line.data();
+
+            #pragma omp for schedule(static) nowait
+            for (size_t j = 0; j < rows; ++j) { // other directions (full range)
+                real_field *row = phi + j*N;
+
+                // inner cells and edges x = 0 and x = N-1
+                flowRow(row+1, row, row+2, flow+1, N-2, alpha);
+                flow[0]   = flowHelper<real>(row[0  ], row[N-1], row[1], dx[dimX], dt);
+                flow[N-1] = flowHelper<real>(row[N-1], row[N-2], row[0], dx[dimX], dt);
+
+                // timestep
+                updateRow(row+1, flow+1, flow, N-1, beta);
+                row[0] += timeStepHelperFlow(flow[0], flow[N-1], dx[dimX], dt);
             }
+            m_instrument.stopThread(phaseSweep, start);
         }
-
-        // deal with edges
-        #pragma omp parallel for
-        for (size_t i = 0; i < N; ++i) { // y-direction
-            // edge x = 0
-            pointvector[i*N].m_flow = flowHelper(
-                        pointvector[i*N    ].m_phi,
-                    pointvector[i*N+N-1].m_phi,
-                    pointvector[i*N+1  ].m_phi,
-                    dx[dimX], dt);
-            // edge x = N-1
-            pointvector[i*N+N-1].m_flow = flowHelper(
-                        pointvector[i*N+N-1].m_phi,
-                    pointvector[i*N+N-2].m_phi,
-                    pointvector[i*N    ].m_phi,
-                    dx[dimX], dt);
+    } else {
+        // direction Y and Z: the grid is cut into slabs of N rows along dim,
+        // which are cut into strips of columns walked row by row. Line buffers
+        // keep the flux of the previous row and the values of the previous row
+        // before its update, so every row is read and written only once.
+        size_t stride = 1; // distance of neighbouring cells along dim, i.e. length of a row
+        for (u_char k = 0; k < dim; ++k) {
+            stride *= N;
         }
+        const size_t slab   = stride*N;
+        const size_t slabs  = NN/slab;
+        const size_t width  = std::min(stride, c_strip_width);
+        const size_t strips = (stride + width - 1)/width;
+
+        #pragma omp parallel
+        {
+            const instrument_t::thread_sample_t start = m_instrument.startThread();
+            real_vector lines(2*width);
+            field_vector rows(2*width);
+            real *flow_left = lines.data();            // flux of the previous row
+            real *flow_row  = flow_left + width;       // flux of the current row
+            real_field *phi_left  = rows.data();       // previous row before its update
+            real_field *phi_first = phi_left + width;  // row 0 before its update
+
+            #pragma omp for schedule(static) nowait
+            for (size_t t = 0; t < slabs*strips; ++t) { // other directions
+                const size_t s = t % strips;
+                const size_t n = std::min(width, stride - s*width);
+                real_field *column = phi + (t/strips)*slab + s*width;
+                const real_field *row_last = column + slab - stride;
+
+                // periodic edges: the row N-1 is the left neighbour of row 0
+                // and row 0 is the right neighbour of row N-1
+                std::copy(column, column + n, phi_first);
+                std::copy(row_last, row_last + n, phi_left);
+                flowRow(row_last, row_last - stride, phi_first, flow_left, n, alpha);
 
-        // timestep
-        #pragma omp parallel for collapse(2)
-        for (size_t j = 0; j < N; ++j) { // y-direction (full range)
-            for (size_t i = 1; i < N; ++i) { // x-direction (range w/o edges)
-                const size_t o = j*N; // offset
-                pointvector[o+i].m_phi += timeStepHelperFlow(
-                            pointvector[o+i].m_flow,
-                        pointvector[o+i-1].m_flow,
-                        dx[dimX], dt);
+                for (size_t j = 0; j < N; ++j) { // along dim (full range)
+                    real_field *row = column + j*stride;
+                    const real_field *row_right = (j == N-1) ? phi_first : row + stride;
+
+                    flowRow(row, phi_left, row_right, flow_row, n, alpha);
+                    std::copy(row, row + n, phi_left);
+                    updateRow(row, flow_row, flow_left, n, beta);
+                    std::swap(flow_left, flow_row);
+                }
             }
+            m_instrument.stopThread(phaseSweep, start);
         }
+    }
+}
 
-        // deal with edges
-        #pragma omp parallel for
-        for (size_t i = 0; i < N; ++i) { // y-direction
-            // edge x = 0
-            pointvector[i*N].m_phi += timeStepHelperFlow(
-                        pointvector[i*N].m_flow,
-                    pointvector[i*N+N-1].m_flow,
-                    dx[dimX], dt);
-        }
-    } else {
-        // direction Y
-
-        // update inner cell values
-        #pragma omp parallel for collapse(2)
-        for (size_t j = 1; j < N-1; ++j) { // y-direction (range w/o edges)
-            for (size_t i = 0; i < N; ++i) { // x-direction (full range)
-                const size_t o = j*N; // offset
-                pointvector[o+i].m_flow = flowHelper(
-                            pointvector[o+i].m_phi,
-                            pointvector[o+i-N].m_phi,
-                            pointvector[o+i+N].m_phi,
-                            dx[dimY], dt);
-            }
+void monores_grid_t::updatePoints()
+{
+    #pragma omp parallel for
+    for (size_t i = 0; i < NN; ++i) {
+        pointvector[i].m_phi = m_phi[i];
+    }
+    m_points_valid = true;
+}
+
+void monores_grid_t::updateArrays()
+{
+    #pragma omp parallel for
+    for (size_t i = 0; i < NN; ++i) {
+        m_phi[i] = pointvector[i].m_phi;
+    }
+}
+
+real monores_grid_t::timeStep()
+{
+    if (m_points_exposed) {
+        // the points might have been altered through the iterator
+        updateArrays();
+        m_points_exposed = false;
+    }
+    m_points_valid = false;
+
+    m_instrument.startStep();
+    const bool forward = m_steps % 2 == 0;
+    for (u_char i = 0; i < g_dimension; ++i) {
+        m_instrument.startPhase(phaseSweep);
+        timeStepDirection(forward ? i : g_dimension-1-i);
+        m_instrument.stopPhase();
+    }
+    ++m_steps;
+
+    m_time += dt;
+    m_instrument.stopStep(m_steps, 1, m_time, NN);
+    return dt;
+}
+
+real monores_grid_t::timeSteps(size_t count)
+{
+    if (m_tile_size == 0) {
+        return grid_t::timeSteps(count);
+    }
+
+    if (m_points_exposed) {
+        // the points might have been altered through the iterator
+        updateArrays();
+        m_points_exposed = false;
+    }
+    m_points_valid = false;
+
+    real time = 0;
+    while (count > 0) {
+        const u_char steps = std::min<size_t>(count, m_fused_steps);
+        m_instrument.startStep();
+        m_instrument.startPhase(phaseTiles);
+        timeStepsTiled(steps);
+        m_instrument.stopPhase();
+        m_steps += steps;
+        count -= steps;
+
+        for (u_char i = 0; i < steps; ++i) {
+            m_time += dt;
+            time += dt;
         }
+        m_instrument.stopStep(m_steps, steps, m_time, NN);
+    }
+    return time;
+}
 
-        // deal with edges
-        #pragma omp parallel for
-        for (size_t i = 0; i < N; ++i) { // x-direction
-            // edge y = 0
-            pointvector[i].m_flow = flowHelper(
-                        pointvector[i    ].m_phi,
-                        pointvector[i+N2-N].m_phi,
-                        pointvector[i+N].m_phi,
-                        dx[dimY], dt);
-            // edge y = N-1
-            pointvector[N2-N+i].m_flow = flowHelper(
-                        pointvector[N2-N+i].m_phi,
-                        pointvector[N2-2*N+i].m_phi,
-                        pointvector[i].m_phi,
-                        dx[dimY], dt);
+void monores_grid_t::timeStepsTiled(const u_char steps)
+{
+    // each sweep invalidates two cells at the lower and one at the upper end
+    // of the tile in its direction
+    const size_t halo  = 2*steps;
+    const size_t tile  = std::min(N, m_tile_size);
+    const size_t tiles_per_dim = (N + tile - 1)/tile;
+    const size_t shift = N - halo % N; // to wrap the halo with unsigned integers
+    size_t tiles = 1;
+    for (u_char dim = 0; dim < g_dimension; ++dim) {
+        tiles *= tiles_per_dim;
+    }
+
+    if (m_phi_next.size() != NN) {
+        m_phi_next.resize(NN);
+    }
+    const real_field *phi  = m_phi.data();
+    real_field *phi_next = m_phi_next.data();
+
+    #pragma omp parallel
+    {
+        const instrument_t::thread_sample_t start = m_instrument.startThread();
+        const size_t length = tile + 2*halo; // maximal edge length of a tile with halo
+        size_t volume = 1;
+        for (u_char dim = 0; dim < g_dimension; ++dim) {
+            volume *= length;
         }
+        field_vector buffer(volume);
+        real_vector lines(2*std::max(length, volume/length));
+        field_vector line(volume/length);
 
-        // timestep
-        #pragma omp parallel for collapse(2)
-        for (size_t j = 1; j < N; ++j) { // y-direction (range w/o edges)
-            for (size_t i = 0; i < N; ++i) { // x-direction (full range)
-                const size_t o = j*N; // offset
-                pointvector[o+i].m_phi += timeStepHelperFlow(
-                            pointvector[o+i].m_flow,
-                            pointvector[o+i-N].m_flow,
-                            dx[dimY], dt);
+        #pragma omp for schedule(static) nowait
+        for (size_t t = 0; t < tiles; ++t) {
+            index_t origin; // first cell of the tile
+            index_t count;  // number of cells of the tile
+            index_t extent; // number of cells of the tile with halo
+            size_t cells = 1;
+            size_t rest = t;
+            for (u_char dim = 0; dim < g_dimension; ++dim) {
+                origin[dim] = (rest % tiles_per_dim)*tile;
+                rest /= tiles_per_dim;
+                count[dim]  = std::min(tile, N - origin[dim]);
+                extent[dim] = count[dim] + 2*halo;
+                cells *= extent[dim];
+            }
+
+            // copy the tile with its periodic halo
+            for (size_t r = 0; r < cells/extent[dimX]; ++r) {
+                size_t offset = 0;
+                size_t stride = N;
+                size_t rest = r;
+                for (u_char dim = 1; dim < g_dimension; ++dim) {
+                    offset += ((origin[dim] + rest % extent[dim] + shift) % N)*stride;
+                    rest /= extent[dim];
+                    stride *= N;
+                }
+                const real_field *src = phi + offset;
+                real_field *dst = buffer.data() + r*extent[dimX];
+                size_t x = (origin[dimX] + shift) % N;
+                for (size_t c = 0; c < extent[dimX]; ++c) {
+                    dst[c] = src[x];
+                    if (++x == N) {
+                        x = 0;
+                    }
+                }
+            }
+
+            for (u_char step = 0; step < steps; ++step) {
+                const bool forward = (m_steps + step) % 2 == 0;
+                for (u_char i = 0; i < g_dimension; ++i) {
+                    sweepTile(buffer.data(), extent, forward ? i : g_dimension-1-i, lines.data(), line.data());
+                }
+            }
+
+            // write back the inner part
+            size_t rows = 1;
+            for (u_char dim = 1; dim < g_dimension; ++dim) {
+                rows *= count[dim];
+            }
+            for (size_t r = 0; r < rows; ++r) {
+                size_t offset_src = halo;
+                size_t offset_dst = origin[dimX];
+                size_t stride_src = extent[dimX];
+                size_t stride_dst = N;
+                size_t rest = r;
+                for (u_char dim = 1; dim < g_dimension; ++dim) {
+                    const size_t i = rest % count[dim];
+                    rest /= count[dim];
+                    offset_src += (i + halo)*stride_src;
+                    offset_dst += (origin[dim] + i)*stride_dst;
+                    stride_src *= extent[dim];
+                    stride_dst *= N;
+                }
+                const real_field *src = buffer.data() + offset_src;
+                std::copy(src, src + count[dimX], phi_next + offset_dst);
             }
         }
+        m_instrument.stopThread(phaseTiles, start);
+    }
 
-        // deal with edges
-        #pragma omp parallel for
-        for (size_t i = 0; i < N; ++i) { // x-direction
-            // edge y = 0
-            pointvector[i].m_phi += timeStepHelperFlow(
-                        pointvector[i    ].m_flow,
-                        pointvector[i+N2-N].m_flow,
-                        dx[dimY], dt);
+    std::swap(m_phi, m_phi_next);
+}
+
+void monores_grid_t::sweepTile(real_field *tile, const index_t &extent, const u_char dim, real *lines, real_field *line) const
+{
+    const flow_kernel_t flowRow = flowKernel();
+    const update_kernel_t updateRow = m_kernels->update;
+    const real alpha = flowCoefficient(dx[dim], dt);
+    const real beta  = timeStepCoefficient(dx[dim], dt);
+
+    size_t stride = 1; // distance of neighbouring cells along dim, i.e. length of a row
+    for (u_char k = 0; k < dim; ++k) {
+        stride *= extent[k];
+    }
+    const size_t length = extent[dim];
+    size_t slabs = 1;
+    for (u_char k = dim+1; k < g_dimension; ++k) {
+        slabs *= extent[k];
+    }
+
+    if (dim == dimX) {
+        real *flow = lines;
+
+        for (size_t j = 0; j < slabs; ++j) {
+            real_field *row = tile + j*length;
+            flowRow(row+1, row, row+2, flow+1, length-2, alpha);
+            updateRow(row+2, flow+2, flow+1, length-3, beta);
+        }
+    } else {
+        real *flow_left = lines;              // flux of the previous row
+        real *flow_row  = flow_left + stride; // flux of the current row
+        real_field *phi_left = line;          // previous row before its update
+
+        for (size_t k = 0; k < slabs; ++k) {
+            real_field *column = tile + k*stride*length;
+            flowRow(column+stride, column, column+2*stride, flow_left, stride, alpha);
+            std::copy(column+stride, column+2*stride, phi_left);
+
+            for (size_t j = 2; j < length-1; ++j) {
+                real_field *row = column + j*stride;
+                flowRow(row, phi_left, row+stride, flow_row, stride, alpha);
+                std::copy(row, row+stride, phi_left);
+                updateRow(row, flow_row, flow_left, stride, beta);
+                std::swap(flow_left, flow_row);
+            }
         }
     }
 }
 
-real monores_grid_t::timeStep()
+void monores_grid_t::setTiling(const size_t tile_size, const u_char fused_steps)
 {
-    static u_short counter = 0;
-    bool flip = counter % 2 == 0;
-    timeStepDirection(flip);
-    timeStepDirection(!flip);
-    ++counter;
+    m_tile_size = tile_size;
+    m_fused_steps = std::max<u_char>(fused_steps, 1);
+}
 
-    m_time += dt;
-    return dt;
+void monores_grid_t::setInstructionSet(isa_t isa)
+{
+    m_kernels = &kernelTable(isa);
 }
 
-grid_t::iterator monores_grid_t::begin()
+void monores_grid_t::getCellLevels(std::vector<u_char> &levels)
 {
-    return iterator(&pointvector[N2-1]);
+    u_char level_max = 0;
+    while ((size_t(1) << level_max) < N) {
+        ++level_max;
+    }
+    levels.assign(NN, level_max);
 }
 
-grid_t::iterator monores_grid_t::end()
+grid_t::iterator monores_grid_t::begin()
 {
-    return iterator();
+    if (!m_points_valid) {
+        updatePoints();
+    }
+    m_points_exposed = true;
+    return grid_t::begin();
 }
@@ -20,49 +20,153 @@
 #include "settings.h"
 
 #include "grid.hpp"
+#include "snapshot.hpp"
 #include "point.hpp"
-
+#include "kernels.hpp"
+
+/*!
+   \brief The monores_grid_t class implements a regular grid on the finest level
+
+   The field values are stored as structure of arrays (\ref m_phi), so the
+   stencils of timeStepDirection() only stream the data they need. The
+   point_t objects in \ref pointvector are a view for grid_t::iterator which is
+   synchronised lazily: begin() copies the arrays into the points and the next
+   timeStep() takes over values which might have been altered through the
+   iterator.
+
+   The sweeps use the vectorised row kernels of kernels.hpp for the best
+   instruction set of the processor. Flux and update are fused into one pass,
+   so the flux is never stored for the whole grid and point_t::m_flow is not
+   set by this grid.
+ */
 class monores_grid_t : public grid_t
 {
 public:
     /*!
        \brief constructs a mono resolution grid
        \param level_max determines the number of nodes in the computation area
+       \param f_eval initializer of the field
 
        The accurancy can be tuned by chosing level_max that is used to compute
        the number of grid points `N = (1 << level_max)` per dimension.
      */
-    monores_grid_t(const u_char level_max);
+    monores_grid_t(const u_char level_max, const field_generator_t &f_eval = g_f_eval);
+
+    /*!
+       \brief restores a mono resolution grid from a checkpoint
+       \param checkpoint record of \ref layoutLeaves, see snapshot_reader_t::raster()
+
+       The grid takes the finest level, the time and the number of time steps
+       of the record. A record written by a monores_grid_t is restored exactly.
+     */
+    explicit monores_grid_t(const snapshot_reader_t &checkpoint);
 
     virtual real timeStep(); // see docu in grid_t
 
+    /*!
+       \brief timeSteps evolves the grid by count time steps using temporal blocking
+
+       The grid is cut into tiles of setTiling() cells per dimension. Every tile
+       is copied with a halo wide enough for several fused time steps into a
+       buffer that fits into the cache, evolved there and its inner part is
+       written to a second array. The grid data is thus streamed once per
+       fused steps instead of twice per time step. The results are identical
+       to calling timeStep() count times.
+
+       \param count number of time steps
+       \return the time passed
+     */
+    virtual real timeSteps(size_t count);
+
+    /*!
+       \brief setTiling configures timeSteps()
+       \param tile_size number of cells per dimension of one tile, 0 disables the tiling
+       \param fused_steps number of time steps evolved on a tile at once
+     */
+    void setTiling(const size_t tile_size, const u_char fused_steps);
+
     virtual size_t size()
-    { return N2; }
+    { return NN; }
+
+    /*!
+       \brief setInstructionSet selects the row kernels used by timeStep()
+       \param isa instruction set, falls back to the generic kernels if unsupported
+     */
+    void setInstructionSet(isa_t isa);
+
+    //! name of the instruction set of the row kernels in use
+    const char *getInstructionSet() const
+    { return m_kernels->name; }
 
     // getters for ranged for, see:
     // http://stackoverflow.com/questions/8164567/how-to-make-my-custom-type-to-work-with-range-based-for-loops
-    virtual iterator begin();
-    virtual iterator end();
+    virtual iterator begin(); // synchronises the points, see updatePoints()
+
+    virtual void getCellLevels(std::vector<u_char> &levels); // documented in grid_t
 
     virtual ~monores_grid_t() {}
 
 private:
     monores_grid_t(const monores_grid_t&) = delete; // remove copy constructor
 
+    //! sets up the grid and takes the field values from checkpoint unless it is nullptr
+    monores_grid_t(const u_char level_max, const field_generator_t &f_eval, const snapshot_reader_t *checkpoint);
+
 
 
     const size_t N; //!< number of points per dimension
-    const size_t N2; //!< number of total points assuming \ref g_dimension = 2
+    const size_t NN; //!< number of total points, `N` to the power of \ref g_dimension
     const location_t dx; //!< grid size in all dimensions of every nodes of this grid
     real dt; //!< time step with respect to \ref g_cfl
 
+    static const size_t c_strip_width = 256; //!< number of columns processed together in the sweeps along y and z
+
     /*!
        \brief implements direction splitting method
-       \param directionX direction to walk to
+       \param dim direction to walk to
+
+       Computes the flux and updates the field values in a single pass.
+     */
+    void timeStepDirection(const u_char dim);
+
+    /*!
+       \brief timeStepsTiled evolves \ref m_phi by some time steps tile by tile, see timeSteps()
+       \param steps number of time steps fused on every tile
      */
-    void timeStepDirection(bool directionX);
+    void timeStepsTiled(const u_char steps);
+
+    /*!
+       \brief sweepTile is timeStepDirection() on a tile without periodic edges
+       \param tile field values, row by row in x-direction
+       \param extent number of cells of the tile per dimension
+       \param dim direction to walk to
+       \param lines flux buffer for the cells of the tile in x-direction and for
+              two times the cells of a cut through the tile across the last dimension
+       \param line buffer for the cells of a cut through the tile across the last dimension
+
+       The two first and the last cells in the walking direction are left invalid.
+     */
+    void sweepTile(real_field *tile, const index_t &extent, const u_char dim, real *lines, real_field *line) const;
+
+    //! flux kernel in use, see \ref g_limiter
+    flow_kernel_t flowKernel() const
+    { return g_limiter ? m_kernels->flowLimited : m_kernels->flow; }
+
+    void updatePoints(); //!< copies \ref m_phi to the points of \ref pointvector
+    void updateArrays(); //!< copies m_phi of the points of \ref pointvector back to \ref m_phi
+
+    field_vector m_phi;  //!< field values, row by row in x-direction
+    field_vector m_phi_next; //!< target of timeStepsTiled(), allocated on first use
+
+    std::vector<point_t> pointvector; //!< point view of the grid data in a 1D array for grid_t::iterator
+    bool m_points_valid; //!< true if \ref pointvector agrees with \ref m_phi
+    bool m_points_exposed; //!< true if \ref pointvector has been handed out by begin() since the last time step
+
+    const kernel_table_t *m_kernels; //!< row kernels of timeStepDirection()
+    size_t m_tile_size; //!< cells per dimension of a tile in timeSteps(), 0 disables tiling
+    u_char m_fused_steps; //!< number of time steps fused on a tile in timeSteps()
 
-    std::vector<point_t> pointvector; //!< actual grid data in a 1D array
+    friend class benchmark_t; // microbenchmarks of the sweeps, see benchRunner
 };
 
 #endif // MONORES_GRID_HPP
@@ -0,0 +1,118 @@
+/***************************************************************************************
+ * Copyright (c) 2014 Robert Riemann <robert@riemann.cc>                                *
+ *                                                                                      *
+ * This program is free software; you can redistribute it and/or modify it under        *
+ * the terms of the GNU General Public License as published by the Free Software        *
+ * Foundation; either version 2 of the License, or (at your option) any later           *
+ * version.                                                                             *
+ *                                                                                      *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY      *
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A      *
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.             *
+ *                                                                                      *
+ * You should have received a copy of the GNU General Public License along with         *
+ * this program.  If not, see <http://www.gnu.org/licenses/>.                           *
+ ****************************************************************************************/
+/*! \file morton.hpp
+
+    \author Robert Riemann (robert@riemann.cc)
+
+    \brief Z-order (Morton) keys of grid indices
+
+    A Morton key interleaves the bits of all components of an \ref index_t, so
+    that sorting points by their key walks the grid along a Z-shaped space
+    filling curve. Bit `b*g_dimension+d` of the key is bit `b` of the index in
+    dimension `d`. The children of a node in the multi resolution tree thus get
+    consecutive keys in the order of node_t::position_t.
+ */
+
+#ifndef MORTON_HPP
+#define MORTON_HPP
+
+#include <cstdint>
+
+#include "settings.h"
+
+typedef uint64_t morton_t; //!< type of a Z-order key
+
+constexpr u_char g_morton_bits = 64/g_dimension; //!< maximum level which can be encoded in a \ref morton_t
+
+/*!
+   \brief morton_encode interleaves the bits of index
+   \param index with components smaller than `1 << g_morton_bits`
+   \return Morton key
+ */
+inline morton_t morton_encode(const index_t &index)
+{
+    morton_t key = 0;
+    for (u_char bit = 0; bit < g_morton_bits; ++bit) {
+        for (u_char dim = 0; dim < g_dimension; ++dim) {
+            key |= morton_t((index[dim] >> bit) & 1) << (bit*g_dimension + dim);
+        }
+    }
+    return key;
+}
+
+/*!
+   \brief morton_decode is the inverse of morton_encode()
+   \param key Morton key
+   \return index
+ */
+inline index_t morton_decode(const morton_t key)
+{
+    index_t index = {{}};
+    for (u_char bit = 0; bit < g_morton_bits; ++bit) {
+        for (u_char dim = 0; dim < g_dimension; ++dim) {
+            index[dim] |= size_t((key >> (bit*g_dimension + dim)) & 1) << bit;
+        }
+    }
+    return index;
+}
+
+/*!
+   \brief morton_mask gives the bits of a key which belong to one dimension
+   \param dim dimension
+   \param level_max number of bits per dimension in use
+   \return bit mask
+ */
+inline morton_t morton_mask(const u_char dim, const u_char level_max)
+{
+    morton_t mask = 0;
+    for (u_char bit = 0; bit < level_max; ++bit) {
+        mask |= morton_t(1) << (bit*g_dimension + dim);
+    }
+    return mask;
+}
+
+/*!
+   \brief morton_level_mask keeps the bits of a key that are significant on a given level
+   \param shift difference between the finest level and the level of interest
+   \return bit mask
+ */
+inline morton_t morton_level_mask(const u_char shift)
+{
+    return (shift*g_dimension >= 64) ? 0 : ~((morton_t(1) << (shift*g_dimension)) - 1);
+}
+
+/*!
+   \brief morton_step moves a key by one cell of a given level in one dimension
+   \param key Morton key
+   \param mask of the dimension to move along, see morton_mask()
+   \param shift difference between the finest level and the level of the cell
+   \param up moves to larger indices if true and smaller indices otherwise
+   \return key of the neighbouring cell
+
+   The addition is done on the dilated integer of one dimension without
+   decoding the key. Overflows wrap around within the bits covered by mask,
+   which yields periodic boundaries.
+ */
+inline morton_t morton_step(const morton_t key, const morton_t mask, const u_char shift, const bool up)
+{
+    const morton_t bits = mask & morton_level_mask(shift);
+    const morton_t one = bits & (~bits + 1); // lowest significant bit of this dimension
+    const morton_t moved = up ? (((key | ~mask) + one) & mask)
+                              : (((key &  mask) - one) & mask);
+    return moved | (key & ~mask);
+}
+
+#endif // MORTON_HPP
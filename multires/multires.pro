@@ -17,4 +17,5 @@ SOURCES += \
 
 HEADERS += \
     node.hpp \
-    multires_grid.hpp
+    multires_grid.hpp \
+    pool.hpp
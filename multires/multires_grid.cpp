@@ -14,29 +14,116 @@
  * this program.  If not, see <http://www.gnu.org/licenses/>.                           *
  ****************************************************************************************/
 
+#include <algorithm>
+
 #include "multires_grid.hpp"
 #include "node.hpp"
 #include "point.hpp"
 
+/*!
+   \brief facing collects the nodes whose cached neighbour in the opposite orientation is node
+   \param node
+   \param orientation to look at from node, a lower one like node_t::posW or node_t::posSouth
+   \param nodes receives the nodes
+   \return number of nodes found
+
+   This is the neighbour of the same level and, if node is a leaf, the
+   children of this neighbour which touch node.
+ */
+static size_t facing(const node_t *node, const char orientation, std::array<const node_t *, 1+g_childs/2> &nodes)
+{
+    size_t count = 0;
+    const node_t *neighbour = node->getCachedNeighbour(orientation);
+    if (neighbour->getLevel() == node->getLevel()) {
+        nodes[count++] = neighbour;
+        if (node->isLeaf() && neighbour->getChilds()) {
+            for (u_char i = 0; i < g_childs/2; ++i) {
+                nodes[count++] = neighbour->getChild(node_t::facingChild(orientation, i));
+            }
+        }
+    }
+    return count;
+}
+
+/*!
+   \brief wraps is true if branching the children of node might read neighbours across the upper boundary
+
+   Each of the up to g_dimension steps of the interpolation of a child in
+   node_t::branch() may end on a node one level coarser. The steps cross the
+   periodic upper boundary only where the ancestor on the coarsest of these
+   levels touches it.
+ */
+static bool wraps(const node_t *node)
+{
+    const int level = std::max(node->getLevel()+1-int(g_dimension), 0);
+    for (u_char dim = 0; dim < g_dimension; ++dim) {
+        if ((node->getIndex()[dim] >> (node->getLevel()-level)) == (size_t(1) << level)-1) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*!
+   \brief unique sorts nodes and removes duplicates
+ */
+static void unique(std::vector<node_t *> &nodes)
+{
+    std::sort(nodes.begin(), nodes.end());
+    nodes.erase(std::unique(nodes.begin(), nodes.end()), nodes.end());
+}
+
+multires_grid_t::multires_grid_t(const u_char level_max, const u_char level_min, real epsilon,
+                                 const field_generator_t &f_eval)
+    : multires_grid_t(level_max, level_min, epsilon, f_eval, nullptr)
+{
+}
+
+multires_grid_t::multires_grid_t(const snapshot_reader_t &checkpoint, const u_char level_min, real epsilon)
+    : multires_grid_t(checkpoint.header().level, level_min, epsilon, g_f_eval, &checkpoint)
+{
+}
 
-multires_grid_t::multires_grid_t(const u_char level_max, const u_char level_min, real epsilon)
-    : m_level_max(level_max)
+multires_grid_t::multires_grid_t(const u_char level_max, const u_char level_min, real epsilon,
+                                 const field_generator_t &f_eval, const snapshot_reader_t *checkpoint)
+    : grid_t(f_eval)
+    , m_level_max(level_max)
     , m_level_min(level_min)
     , m_level_start((level_max+level_min)/2)
+    , m_epsilon(epsilon)
     , dt(g_cfl*g_span[dimX]/((1 << level_max)*g_velocity))
+    , m_incremental(false)
+    , m_incremental_ready(false)
+    , m_tolerance(0)
+    , m_leaves_added(0)
+    , m_remesh_policy(remeshSteps)
+    , m_remesh_budget(1)
+    , m_remesh_period(1)
+    , m_zone_width(level_max+1, 1)
 {
 
     m_root_point = new point_t({{}}, m_level_max);
     assert(m_root_point->m_index[0] == 0);
-    m_root_point->setNext(nullptr);
-
-    node_t::setGrid(this);
-    node_t::setEpsilon(epsilon);
 
     m_root_node = new node_t();
     m_root_node->initialize(nullptr, node_t::lvlRoot, node_t::posRoot, {{}}, m_root_point);
+
+    if (checkpoint) {
+        // the tree of the checkpoint has already been optimised by remesh()
+        std::vector<snapshot_node_t> nodes;
+        const bool valid = checkpoint->tree(nodes);
+        assert(valid);
+        (void)valid;
+        restore(m_root_node, nodes, 0);
+        updateTopology();
+        m_time = checkpoint->header().time;
+        m_steps = checkpoint->header().step;
+        return;
+    }
+
     // create level_start-depth new children
-    m_root_node->branch(m_level_start);
+    m_root_node->branch(*this, m_level_start);
+    updateTopology();
 
     /*
     for(point_t &point: *this) {
@@ -49,70 +136,589 @@ multires_grid_t::multires_grid_t(const u_char level_max, const u_char level_min,
     size_t size_old;
     do {
         size_old = size_new;
-        /* FIXME: doesn't work because of wrong implementation of iterator :/
-        #pragma omp parallel for
-        for(auto point = begin(); point < end(); ++point) {
-            point->m_phi = g_f_eval(point->m_x);
-            point->m_phiBackup = point->m_phi;
-        }
-        */
-        for(point_t &point: *this) {
-            point.m_phi = s_f_eval(point.m_x);
-        }
+        initializePoints();
         remesh();
         size_new = size();
         std::cerr << "initalizing: " << size_old << " -> " << size_new << std::endl;
     } while (size_old != size_new);
 }
 
+void multires_grid_t::restore(node_t *node, const std::vector<snapshot_node_t> &nodes, const size_t index)
+{
+    const snapshot_node_t &snapshot_node = nodes[index];
+    if (snapshot_node.childs == 0) {
+        // the first child shares the point with its ancestors, so the leaf sets it
+        node->getPoint()->m_phi = snapshot_node.phi;
+        return;
+    }
+    node->branch(*this, 1);
+    for (u_char pos = 0; pos < g_childs; ++pos) {
+        restore(node->getChild(pos), nodes, snapshot_node.childs + pos);
+    }
+}
+
 void multires_grid_t::remesh()
 {
-    m_root_node->remesh_analyse();
-    m_root_node->remesh_savety();
-    m_root_node->remesh_clean();
+    if (m_incremental && m_incremental_ready) {
+        m_instrument.startPhase(phaseIncremental);
+        remeshIncremental();
+        m_instrument.stopPhase();
+        return;
+    }
+
+    m_instrument.startPhase(phaseAnalyse);
+    remeshAnalyse();
+    m_instrument.stopPhase();
+    m_instrument.startPhase(phaseSavety);
+    remeshSavety();
+    m_instrument.stopPhase();
+    m_instrument.startPhase(phaseClean);
+    remeshClean();
+    m_instrument.stopPhase();
+    m_instrument.startPhase(phaseTopology);
+    updateTopology();
+    m_instrument.stopPhase();
+
+    if (m_incremental) {
+        m_references.resize(m_leaves.size());
+        m_leaves_added = 0;
+        m_pending.assign(std::max<size_t>(m_levels.size(), m_level_max+1), std::vector<node_t *>());
+        for (size_t i = 0; i < m_leaves.size(); ++i) {
+            m_references[i] = m_leaves[i]->getPoint()->m_phi;
+            // the leaves include the nodes just created by the savety zone
+            enqueue(m_leaves[i]);
+        }
+        m_incremental_ready = true;
+    }
 }
 
-real multires_grid_t::timeStep()
+void multires_grid_t::remeshAnalyse()
+{
+    for (size_t level = m_levels.size(); level-- > 0;) {
+        const std::vector<node_t *> &nodes = m_levels[level];
+        const size_t count = nodes.size();
+        #pragma omp parallel
+        {
+            const instrument_t::thread_sample_t start = m_instrument.startThread();
+            #pragma omp for schedule(dynamic, 64) nowait
+            for (size_t i = 0; i < count; ++i) {
+                nodes[i]->remesh_analyse(*this);
+            }
+            m_instrument.stopThread(phaseAnalyse, start);
+        }
+    }
+}
+
+void multires_grid_t::remeshSavety()
+{
+    /* The savety zone is defined by branching depth first, see
+       node_t::depthFirst(), as branch() interpolates the new points from the
+       tree as it is being refined. The interpolation reads only the children of
+       coarser nodes than the ones it branches, in upper directions. So the
+       nodes of one level can be done in parallel starting with the finest one,
+       and they see the same tree as depth first unless the neighbours wrap
+       around the upper boundary to the nodes done before.
+    */
+    std::vector<node_t *> branched, wrapping;
+    #pragma omp parallel
+    {
+        const instrument_t::thread_sample_t start = m_instrument.startThread();
+        std::vector<node_t *> branched_thread, wrapping_thread;
+        for (size_t level = m_levels.size(); level-- > 0;) {
+            const std::vector<node_t *> &nodes = m_levels[level];
+            const size_t count = nodes.size();
+            // the barrier at the end keeps the levels apart
+            #pragma omp for schedule(dynamic, 64)
+            for (size_t i = 0; i < count; ++i) {
+                if (nodes[i]->remesh_savety(*this)) {
+                    branched_thread.push_back(nodes[i]);
+                    if (wraps(nodes[i])) {
+                        wrapping_thread.push_back(nodes[i]);
+                    }
+                }
+            }
+        }
+        #pragma omp critical(savety)
+        {
+            branched.insert(branched.end(), branched_thread.begin(), branched_thread.end());
+            wrapping.insert(wrapping.end(), wrapping_thread.begin(), wrapping_thread.end());
+        }
+        m_instrument.stopThread(phaseSavety, start);
+    }
+
+    // the nodes whose new points might have read around the upper boundary are done again in depth first order
+    const instrument_t::thread_sample_t start = m_instrument.startThread();
+    std::sort(wrapping.begin(), wrapping.end(), node_t::depthFirst);
+    for (const node_t *node: wrapping) {
+        for (node_t &child: *node->getChilds()) {
+            if (child.has(node_t::flBranched)) {
+                child.reinterpolate(node);
+            }
+        }
+    }
+    for (const node_t *node: branched) {
+        for (node_t &child: *node->getChilds()) {
+            child.unset(node_t::flBranched);
+        }
+    }
+    m_instrument.stopThread(phaseSavety, start);
+}
+
+void multires_grid_t::remeshClean()
+{
+    // the incremental remesh continues with the flags
+    #pragma omp parallel
+    #pragma omp single
+    m_root_node->remesh_clean(*this, !m_incremental);
+}
+
+void multires_grid_t::remeshIncremental()
+{
+    const size_t depth = m_pending.size();
+
+    // dirty leaves
+    const real tolerance = m_tolerance*m_epsilon;
+    for (size_t i = 0; i < m_leaves.size(); ++i) {
+        const real phi = m_leaves[i]->getPoint()->m_phi;
+        if (fabs(phi - m_references[i]) > tolerance) {
+            m_references[i] = phi;
+            // the first children share the point with their parent
+            node_t *node = m_leaves[i];
+            for (;;) {
+                // interpolations reading the point as upper neighbour in any dimensions
+                enqueueInterpolations(node, g_dimension-1);
+                if (node->getPosition() != node_t::posSW) {
+                    break;
+                }
+                node = node->m_parent;
+            }
+            if (node->getPosition() == g_childs-1) {
+                enqueue(node);
+            }
+        }
+    }
+
+    // analyse level by level starting with the finest, see remesh()
+    std::vector<std::vector<node_t *>> savety(depth), clean(depth);
+    std::vector<char> flipped;
+    for (size_t level = depth; level-- > 0;) {
+        std::vector<node_t *> &nodes = m_pending[level];
+        const size_t count = nodes.size();
+        flipped.assign(count, false);
+        #pragma omp parallel for schedule(dynamic, 64)
+        for (size_t i = 0; i < count; ++i) {
+            const bool active = nodes[i]->has(node_t::flActive);
+            flipped[i] = (nodes[i]->remesh_analyse(*this) != active);
+        }
+        for (size_t i = 0; i < count; ++i) {
+            if (flipped[i] && level > 0) {
+                // the parent and the nodes having it in their zone look at the children
+                node_t *parent = nodes[i]->m_parent;
+                enqueue(parent);
+                parent->forEachInZone(m_zone_width[level-1], [this](const node_t *node) {
+                    enqueue(const_cast<node_t *>(node));
+                }, true);
+                savety[level-1].push_back(parent);
+                if (!nodes[i]->has(node_t::flActive)) {
+                    clean[level-1].push_back(parent);
+                }
+            }
+        }
+        nodes.clear();
+    }
+
+    // savety zone of the parents whose children changed, see node_t::remesh_savety(),
+    // in the depth first order of remeshSavety(), as the new points are interpolated from the tree
+    std::vector<node_t *> parents;
+    for (size_t level = 0; level+1 < std::min<size_t>(depth, m_level_max); ++level) {
+        unique(savety[level]);
+        parents.insert(parents.end(), savety[level].begin(), savety[level].end());
+    }
+    std::sort(parents.begin(), parents.end(), node_t::depthFirst);
+    std::vector<std::vector<node_t *>> altered(depth); // branched or debranched nodes
+    for (node_t *node: parents) {
+        const size_t level = node->getLevel();
+        bool active = false;
+        for (const node_t &child: *node->getChilds()) {
+            active = active || child.has(node_t::flActive);
+        }
+        for (node_t &child: *node->getChilds()) {
+            if (active) {
+                if (child.isLeaf()) {
+                    const real reference = removeLeaf(&child);
+                    child.branch(*this);
+                    altered[level+1].push_back(&child);
+                    for (node_t &grandchild: *child.getChilds()) {
+                        addLeaf(&grandchild, (grandchild.getPosition() == node_t::posSW)
+                                             ? reference : grandchild.getPoint()->m_phi);
+                        enqueue(&grandchild);
+                    }
+                }
+                for (node_t &grandchild: *child.getChilds()) {
+                    grandchild.set(node_t::flSavetyZone);
+                }
+            } else if (child.getChilds()) {
+                for (node_t &grandchild: *child.getChilds()) {
+                    grandchild.unset(node_t::flSavetyZone);
+                }
+                clean[level+1].push_back(&child);
+            }
+        }
+    }
+
+    // mark the nodes losing their children from the finest level on, see node_t::remesh_clean()
+    std::vector<node_t *> marked;
+    for (size_t level = depth; level-- > 0;) {
+        std::vector<node_t *> &nodes = clean[level];
+        unique(nodes);
+        for (node_t *node: nodes) {
+            if (!node->getChilds()) {
+                continue;
+            }
+            bool removable = true;
+            for (const node_t &child: *node->getChilds()) {
+                removable = removable && (child.isLeaf() || child.has(node_t::flDebranch))
+                            && !child.has(node_t::flSavetyZone) && !child.has(node_t::flActive);
+            }
+            if (removable) {
+                node->set(node_t::flDebranch);
+                marked.push_back(node);
+                if (level > 0) {
+                    clean[level-1].push_back(node->m_parent);
+                }
+            }
+        }
+    }
+    // marked is ordered from fine to coarse, so a node is visited before it is removed by its ancestor
+    for (node_t *node: marked) {
+        if (node->m_parent && node->m_parent->has(node_t::flDebranch)) {
+            continue;
+        }
+        node_t *leaf = node;
+        while (!leaf->isLeaf()) {
+            leaf = leaf->getChild(node_t::posSW);
+        }
+        const real reference = m_references[leaf->m_leaf];
+        collapse(node);
+        node->unset(node_t::flDebranch);
+        addLeaf(node, reference);
+        altered[node->getLevel()].push_back(node);
+    }
+
+    // repair the neighbour cache from the coarsest level on, see updateTopology()
+    std::vector<std::vector<node_t *>> recache(depth+1);
+    std::vector<const node_t *> changed;
+    for (size_t level = 0; level < depth; ++level) {
+        std::vector<node_t *> &nodes = recache[level];
+        unique(nodes);
+        for (node_t *node: nodes) {
+            const std::array<const node_t *, g_orientations> neighbours = node->m_neighbours;
+            node->cacheNeighbours();
+            if (neighbours != node->m_neighbours) {
+                changed.push_back(node);
+                if (node->getChilds()) {
+                    for (node_t &child: *node->getChilds()) {
+                        recache[level+1].push_back(&child);
+                    }
+                }
+            }
+        }
+        for (const node_t *node: altered[level]) {
+            if (node->getChilds()) {
+                for (node_t &child: *node->getChilds()) {
+                    recache[level+1].push_back(&child);
+                }
+            }
+            // children of the neighbours touching node
+            for (char orientation = 0; orientation < g_orientations; ++orientation) {
+                const node_t *neighbour = node->getCachedNeighbour(orientation);
+                if (neighbour->getLevel() == level && neighbour->getChilds()) {
+                    for (u_char i = 0; i < g_childs/2; ++i) {
+                        recache[level+1].push_back(neighbour->getChild(node_t::facingChild(orientation, i)));
+                    }
+                }
+            }
+        }
+    }
+    for (const node_t *node: changed) {
+        // interpolations stepping on from node, see node_t::interpolation()
+        enqueueInterpolations(node, g_dimension-2);
+    }
+
+    compactLeaves();
+}
+
+void multires_grid_t::enqueueInterpolations(const node_t *node, const char dimension)
+{
+    if (dimension < 0) {
+        if (node->getChilds()) {
+            enqueue(node->getChild(g_childs-1));
+        }
+        return;
+    }
+    enqueueInterpolations(node, dimension-1);
+    std::array<const node_t *, 1+g_childs/2> nodes;
+    const size_t count = facing(node, node_t::orientation(dimension, false), nodes);
+    for (size_t i = 0; i < count; ++i) {
+        enqueueInterpolations(nodes[i], dimension-1);
+    }
+}
+
+void multires_grid_t::addLeaf(node_t *node, const real reference)
+{
+    node->m_leaf = m_leaves.size();
+    m_leaves.push_back(node);
+    m_references.push_back(reference);
+    ++m_leaves_added;
+}
+
+real multires_grid_t::removeLeaf(node_t *node)
+{
+    // the hole is closed by compactLeaves() to keep the order of the leaves
+    m_leaves[node->m_leaf] = nullptr;
+    return m_references[node->m_leaf];
+}
+
+void multires_grid_t::compactLeaves()
+{
+    if (m_leaves_added > m_leaves.size()/4) {
+        // restore the order of the tree once many leaves are appended
+        orderLeaves(true);
+        m_leaves_added = 0;
+    } else {
+        size_t count = 0;
+        for (size_t i = 0; i < m_leaves.size(); ++i) {
+            if (m_leaves[i]) {
+                m_leaves[count] = m_leaves[i];
+                m_leaves[count]->m_leaf = count;
+                m_references[count] = m_references[i];
+                ++count;
+            }
+        }
+        m_leaves.resize(count);
+        m_references.resize(count);
+    }
+    updatePointIndex();
+}
+
+void multires_grid_t::orderLeaves(const bool references)
+{
+    std::vector<node_t *> leaves;
+    std::vector<real> references_ordered;
+    leaves.reserve(m_leaves.size());
+    if (references) {
+        references_ordered.reserve(m_leaves.size());
+    }
+
+    // depth-first with the children in the order of their positions
+    std::vector<node_t *> stack(1, m_root_node);
+    while (!stack.empty()) {
+        node_t *node = stack.back();
+        stack.pop_back();
+        if (node->isLeaf()) {
+            if (references) {
+                references_ordered.push_back(m_references[node->m_leaf]);
+            }
+            node->m_leaf = leaves.size();
+            leaves.push_back(node);
+        } else {
+            for (size_t pos = g_childs; pos-- > 0;) {
+                stack.push_back(node->getChild(pos));
+            }
+        }
+    }
+    m_leaves.swap(leaves);
+    if (references) {
+        m_references.swap(references_ordered);
+    }
+}
+
+void multires_grid_t::getCellLevels(std::vector<u_char> &levels)
+{
+    const size_t count = m_leaves.size();
+    levels.resize(count);
+    #pragma omp parallel for schedule(static)
+    for (size_t i = 0; i < count; ++i) {
+        levels[i] = m_leaves[i]->getLevel();
+    }
+}
+
+void multires_grid_t::updatePointIndex()
+{
+    // every point belongs to exactly one leaf, the others share it with their first child
+    const size_t count = m_leaves.size();
+    m_point_index.resize(count);
+    #pragma omp parallel for schedule(static)
+    for (size_t i = 0; i < count; ++i) {
+        m_point_index[i] = m_leaves[i]->getPoint();
+    }
+}
+
+void multires_grid_t::collapse(node_t *node)
+{
+    // debranch() frees the whole subtree, so its leaves go first
+    for (node_t &child: *node->getChilds()) {
+        if (child.getChilds()) {
+            collapse(&child);
+        } else {
+            removeLeaf(&child);
+        }
+    }
+    node->debranch(*this);
+}
+
+void multires_grid_t::updateTopology()
 {
-    static u_short counter = 0;
-    if (counter % 2 == 0) {
-        m_root_node->updateFlow(node_t::posRight);
-        m_root_node->timeStep(node_t::posRight);
+    // collect the nodes level by level, the neighbours of a node are derived
+    // from the ones of its parent
+    m_levels.resize(1);
+    m_levels[0].assign(1, m_root_node);
+    m_root_node->cacheNeighbours();
+
+    for (size_t level = 0; ; ++level) {
+        if (m_levels.size() == level+1) {
+            m_levels.resize(level+2);
+        }
+        std::vector<node_t *> &nodes = m_levels[level+1];
+        nodes.clear();
+        for (const node_t *parent: m_levels[level]) {
+            if (parent->getChilds()) {
+                for (node_t &node: *parent->getChilds()) {
+                    nodes.push_back(&node);
+                }
+            }
+        }
+        if (nodes.empty()) {
+            m_levels.resize(level+1);
+            break;
+        }
+
+        const size_t count = nodes.size();
+        #pragma omp parallel for schedule(static)
+        for (size_t i = 0; i < count; ++i) {
+            nodes[i]->cacheNeighbours();
+        }
+    }
+
+    for (size_t level = m_levels.size(); level-- > 0;) {
+        const std::vector<node_t *> &nodes = m_levels[level];
+        const size_t count = nodes.size();
+        #pragma omp parallel for schedule(static)
+        for (size_t i = 0; i < count; ++i) {
+            nodes[i]->updateWeight();
+        }
+    }
 
-        m_root_node->updateFlow(node_t::posNorth);
-        m_root_node->timeStep(node_t::posNorth);
+    orderLeaves(false);
+    updatePointIndex();
+}
+
+void multires_grid_t::sweep(const char direction)
+{
+    if (g_limiter) {
+        sweep<true>(direction);
     } else {
-        m_root_node->updateFlow(node_t::posNorth);
-        m_root_node->timeStep(node_t::posNorth);
+        sweep<false>(direction);
+    }
+}
 
-        m_root_node->updateFlow(node_t::posRight);
-        m_root_node->timeStep(node_t::posRight);
+template<bool limiter>
+void multires_grid_t::sweep(const char direction)
+{
+    const size_t count = m_leaves.size();
+    m_instrument.startPhase(phaseFlow);
+    #pragma omp parallel
+    {
+        const instrument_t::thread_sample_t start_flow = m_instrument.startThread();
+        #pragma omp for schedule(guided) nowait
+        for (size_t i = 0; i < count; ++i) {
+            m_leaves[i]->updateFlow<limiter>(direction, dt);
+        }
+        m_instrument.stopThread(phaseFlow, start_flow);
+        // all fluxes are known before the time step
+        #pragma omp barrier
+        #pragma omp master
+        {
+            m_instrument.stopPhase();
+            m_instrument.startPhase(phaseUpdate);
+        }
+        const instrument_t::thread_sample_t start_update = m_instrument.startThread();
+        #pragma omp for schedule(guided) nowait
+        for (size_t i = 0; i < count; ++i) {
+            m_leaves[i]->timeStep(direction, dt);
+        }
+        m_instrument.stopThread(phaseUpdate, start_update);
     }
-    ++counter;
+    m_instrument.stopPhase();
+}
 
-    remesh();
+real multires_grid_t::timeStep()
+{
+    m_instrument.startStep();
+    if (m_steps % 2 == 0) {
+        for (u_char dim = 0; dim < g_dimension; ++dim) {
+            sweep(node_t::orientation(dim, true));
+        }
+    } else {
+        for (u_char dim = g_dimension; dim-- > 0;) {
+            sweep(node_t::orientation(dim, true));
+        }
+    }
+    ++m_steps;
+
+    if (m_steps % m_remesh_period == 0) {
+        remesh();
+    }
 
     m_time += dt;
+    m_instrument.stopStep(m_steps, 1, m_time, m_leaves.size());
     return dt;
 }
 
 void multires_grid_t::unfold(u_char level_max)
 {
-    m_root_node->branch(level_max);
+    m_root_node->branch(*this, level_max);
+    updateTopology();
+    m_incremental_ready = false;
 }
 
-multires_grid_t::~multires_grid_t()
+void multires_grid_t::setRemeshPolicy(const remesh_policy_t policy, const real budget)
 {
-    delete m_root_node;
-    delete m_root_point;
+    m_remesh_policy = policy;
+    m_remesh_budget = budget;
+    // the flags of the nodes depend on the zone
+    m_incremental_ready = false;
+
+    // distance moved by one time step in cells of the finest level
+    const real distance = g_velocity*dt/(g_span[dimX]/(1 << m_level_max));
+    const real step = (policy == remeshSteps) ? 1 : distance;
+    real progress = 0;
+    m_remesh_period = 0;
+    do {
+        ++m_remesh_period;
+        progress += step;
+    } while (progress + step <= budget*(1+1e-9));
+
+    const real moved = (policy == remeshSteps) ? std::max<real>(1, std::floor(budget))*distance
+                                               : std::max(budget, distance);
+    for (size_t level = 0; level < m_zone_width.size(); ++level) {
+        const real width = 1 + std::ceil(g_dimension*(moved - distance)*std::pow(2., int(level) - m_level_max));
+        m_zone_width[level] = u_char(std::min<real>(width, 255));
+    }
 }
 
-grid_t::iterator multires_grid_t::begin()
+void multires_grid_t::setIncrementalRemesh(const bool enable, const real tolerance)
 {
-    return iterator(m_root_point);
+    m_incremental = enable;
+    m_incremental_ready = false;
+    m_tolerance = tolerance;
 }
 
-grid_t::iterator multires_grid_t::end()
+multires_grid_t::~multires_grid_t()
 {
-    return iterator();
+    if (m_root_node->getChilds()) {
+        m_root_node->debranch(*this);
+    }
+    delete m_root_node;
+    delete m_root_point;
 }
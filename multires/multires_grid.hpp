@@ -25,8 +25,9 @@
 
 #include "settings.h"
 #include "grid.hpp"
-
-class node_t;
+#include "snapshot.hpp"
+#include "node.hpp"
+#include "pool.hpp"
 
 /*!
    \brief The multires_grid_t class implements a grid based on multi resolution analysis (MRA)
@@ -39,40 +40,260 @@ public:
        \param level_max finest level of this grid
        \param level_min coarsest level of this grid
        \param epsilon threshold value to dismiss nodes
+       \param f_eval initializer of the field
+     */
+    multires_grid_t(const u_char level_max, const u_char level_min = 0, real epsilon = g_epsilon,
+                    const field_generator_t &f_eval = g_f_eval);
+
+    /*!
+       \brief multires_grid_t restores a grid from a checkpoint
+       \param checkpoint record of \ref layoutLeaves, e.g. written by snapshot_writer_t
+       \param level_min coarsest level of this grid
+       \param epsilon threshold value to dismiss nodes
+
+       The tree, the field values, the time and the number of time steps are
+       taken from the record, the finest level is snapshot_header_t::level.
+       With the level_min and epsilon of the run which wrote the record, the
+       restored grid continues exactly like the original one.
+
+       The state of the incremental remesh is not part of the record: the
+       flags of the nodes, the reference values of the leaves and the pending
+       nodes. The first remesh after the restore is a full one. A run with
+       setIncrementalRemesh() is only continued exactly if its tolerance is 0,
+       because then it gives the mesh of the full remesh.
      */
-    multires_grid_t(const u_char level_max, const u_char level_min = 0, real epsilon = g_epsilon);
+    multires_grid_t(const snapshot_reader_t &checkpoint, const u_char level_min = 0, real epsilon = g_epsilon);
 
     virtual real timeStep(); // documented in grid_t
 
     void unfold(u_char level_max); //!< creates nodes up to the finest grid to get a regular grid with finest resolution according to m_level_max
 
+    virtual void getCellLevels(std::vector<u_char> &levels); // documented in grid_t
+
+    /*!
+       \brief setIncrementalRemesh lets the remesh after each time step revisit only the regions where the field has changed
+       \param enable
+       \param tolerance change of a leaf value relative to epsilon which makes it dirty
+
+       A leaf is dirty if its value differs by more than tolerance*epsilon from
+       the value it had when its residuals were evaluated the last time. Only
+       the residuals depending on dirty leaves or on altered parts of the tree
+       are evaluated again, so the cost of the remesh follows the moving front
+       instead of the size of the grid. A tolerance of 0 gives the same mesh as
+       the full remesh. The first remesh after enabling is a full one.
+     */
+    void setIncrementalRemesh(const bool enable, const real tolerance = 0.1);
+
+    /*!
+       \brief The remesh_policy_t enum lists the ways timeStep() decides to call remesh()
+     */
+    enum remesh_policy_t {
+          remeshSteps    //!< remesh after a number of time steps
+        , remeshDistance //!< remesh before the solution moves further than a number of cells of the finest level
+    };
+
+    /*!
+       \brief setRemeshPolicy sets how often timeStep() adapts the mesh
+       \param policy
+       \param budget number of time steps or cells of the finest level, see remesh_policy_t
+
+       Between two calls of remesh() the solution moves by several time steps,
+       so the zone in which node_t::remesh_analyse() looks for active children
+       of neighbours grows accordingly, see \ref m_zone_width. The default is
+       a remesh after every time step.
+
+       The budget is turned into a period of time steps counted from the
+       first one, see grid_t::getSteps(), so a grid restored from a checkpoint
+       remeshes at the same time steps as the grid which wrote it.
+     */
+    void setRemeshPolicy(const remesh_policy_t policy, const real budget);
+
     const node_t *getRootNode() const
     { return m_root_node; }
 
-    virtual ~multires_grid_t();
+    typedef pool_t<node_t::node_array_t> node_pool_t; //!< allocator for the children of a node
+    typedef pool_t<point_t> point_pool_t; //!< allocator for the points of the nodes
+
+    /*!
+       \brief getNodePool gives access to the allocator of the children arrays, e.g. to query its statistics
+     */
+    const node_pool_t &getNodePool() const
+    { return m_node_pool; }
 
-    virtual iterator begin();
-    virtual iterator end();
+    /*!
+       \brief getPointPool gives access to the allocator of the points, e.g. to query its statistics
+     */
+    const point_pool_t &getPointPool() const
+    { return m_point_pool; }
+
+    virtual ~multires_grid_t();
 
 private:
     multires_grid_t(const multires_grid_t&) = delete; // remove copy constructor
 
+    //! sets up the grid and restores the tree from checkpoint unless it is nullptr
+    multires_grid_t(const u_char level_max, const u_char level_min, real epsilon, const field_generator_t &f_eval,
+                    const snapshot_reader_t *checkpoint);
+
     u_char m_level_max; //!< maximum level, finest grid
     u_char m_level_min; //!< minimum level, coarsest grid
     u_char m_level_start; //!< level to start with at initialization
+    real m_epsilon; //!< threshold of node_t::remesh_analyse(), see \ref g_epsilon
     real dt; //!< global time step
     node_t *m_root_node; //!< pointer to the root node of the underlying tree
     point_t *m_root_point; //!< pointer to the point_t in the lower left edge (root point)
+    node_pool_t m_node_pool; //!< recycles the children arrays of the nodes across remesh() calls
+    point_pool_t m_point_pool; //!< recycles the points of the nodes across remesh() calls
+    std::vector<std::vector<node_t *>> m_levels; //!< all nodes per level for the parallel loops of remesh(), see updateTopology()
+    std::vector<node_t *> m_leaves; //!< all leaves, ordered depth-first after updateTopology()
+    bool m_incremental; //!< see setIncrementalRemesh()
+    bool m_incremental_ready; //!< the flags of the nodes, \ref m_references and \ref m_pending are valid for remeshIncremental()
+    real m_tolerance; //!< see setIncrementalRemesh()
+    std::vector<real> m_references; //!< value of each leaf at its last analysis, same order as \ref m_leaves
+    size_t m_leaves_added; //!< number of addLeaf() calls since \ref m_leaves has been ordered
+    std::vector<std::vector<node_t *>> m_pending; //!< nodes per level to be analysed by the next remeshIncremental()
+    remesh_policy_t m_remesh_policy; //!< see setRemeshPolicy()
+    real m_remesh_budget; //!< see setRemeshPolicy()
+    size_t m_remesh_period; //!< time steps between two calls of remesh(), see setRemeshPolicy()
+
+    /*!
+       \brief number of steps to neighbours of the same level per level, see node_t::forEachInZone()
+
+       The front moves by up to D cells of the finest level between two remeshes
+       and remesh_analyse() covers the first step with a width of 1, so a level
+       l gets 1 + ceil(g_dimension*(D - step)*2^(l - m_level_max)).
+     */
+    std::vector<u_char> m_zone_width;
 
     /*!
        \brief remesh adopts the local granularity of the mesh
 
+       The analysis and the savety zone are done level by level from the finest
+       to the coarsest level as a node depends on its children and on the
+       children of its neighbours. Within one level the nodes are processed by
+       parallel loops, so the work is spread according to the refinement and
+       not to the tree depth. The savety zone gives the points of the depth first
+       order, see remeshSavety(). If enabled, remeshIncremental() is called instead.
+
        \see node_t::remesh_analyse(), node_t::remesh_savety(), node_t::remesh_clean()
      */
     void remesh();
 
+    void remeshAnalyse(); //!< first phase of remesh(), node_t::remesh_analyse() level by level
+    /*!
+       \brief remeshSavety is the second phase of remesh(), node_t::remesh_savety() level by level
+
+       The new points of the nodes near the upper boundary, whose interpolation
+       may read neighbours across it, are interpolated again on one thread in
+       the order of node_t::depthFirst(), so the points do not depend on the
+       number of threads.
+     */
+    void remeshSavety();
+    void remeshClean(); //!< third phase of remesh(), node_t::remesh_clean() from the root
+    /*!
+       \brief remeshIncremental does the same as remesh() for the dirty regions only
+
+       The flags of the nodes are kept from the last remesh. The dirty leaves
+       enqueue the nodes whose residual reads their point. A node whose flag
+       **active** changes enqueues its parent and the neighbours of its parent
+       on the next coarser level, and its parent updates the savety zone and
+       is checked for removable children. At last the neighbour cache is
+       repaired around the altered nodes, which enqueues the residuals using
+       the repaired neighbours for the next call.
+     */
+    void remeshIncremental();
+
+    /*!
+       \brief enqueue adds a node to \ref m_pending unless it is already pending
+     */
+    void enqueue(node_t *node)
+    {
+        if (!node->has(node_t::flPending)) {
+            node->set(node_t::flPending);
+            m_pending[node->getLevel()].push_back(node);
+        }
+    }
+
+    /*!
+       \brief enqueueInterpolations enqueues the center children of node and of the nodes having node as upper neighbour
+       \param node
+       \param dimension last dimension to look at, -1 takes only node itself
+
+       These are the nodes which reach node by steps along the dimensions up to
+       dimension. With `g_dimension-1`, their residuals depend on the point of
+       node, and with `g_dimension-2` on the cached neighbours of node, see
+       node_t::interpolation().
+     */
+    void enqueueInterpolations(const node_t *node, const char dimension);
+
+    /*!
+       \brief addLeaf appends node to \ref m_leaves
+       \param node
+       \param reference see \ref m_references
+     */
+    void addLeaf(node_t *node, const real reference);
+
+    /*!
+       \brief removeLeaf leaves a hole at the place of node in \ref m_leaves
+       \return reference of the removed leaf, see \ref m_references
+     */
+    real removeLeaf(node_t *node);
+
+    /*!
+       \brief compactLeaves closes the holes left by removeLeaf() without changing the order of the leaves
+
+       The sweeps are faster if neighbouring leaves stay close in \ref m_leaves,
+       so the leaves are ordered by a walk through the tree again once a quarter
+       of them has been appended by addLeaf().
+     */
+    void compactLeaves();
+
+    /*!
+       \brief orderLeaves collects \ref m_leaves by a depth-first walk through the tree
+       \param references keeps \ref m_references along with the leaves
+
+       Neighbouring leaves are close in this order and it is the order in which
+       the points have always been iterated.
+     */
+    void orderLeaves(const bool references);
+
+    /*!
+       \brief restore creates the subtree of node given by the checkpoint
+       \param node to be branched
+       \param nodes tree of the checkpoint, see snapshot_reader_t::tree()
+       \param index of node in nodes
+     */
+    void restore(node_t *node, const std::vector<snapshot_node_t> &nodes, const size_t index);
+
+    /*!
+       \brief updatePointIndex fills grid_t::m_point_index with the points of \ref m_leaves
+     */
+    void updatePointIndex();
+
+    /*!
+       \brief collapse removes all descendants of node from \ref m_leaves and from the tree
+     */
+    void collapse(node_t *node);
+
+    /*!
+       \brief updateTopology refreshes \ref m_levels, the neighbour cache, the subtree weights, \ref m_leaves and the point index after the tree has been altered
+     */
+    void updateTopology();
+
+    /*!
+       \brief sweep updates the flux and then the field values of all leaves in one direction
+       \param direction
+
+       The leaves only read their neighbours during each of the two phases, so
+       they are processed as flat loops over \ref m_leaves. The loops are
+       compiled with and without limiter, see \ref g_limiter.
+     */
+    void sweep(const char direction);
+    template<bool limiter>
+    void sweep(const char direction);
 
     friend class node_t;
+    friend class benchmark_t; // microbenchmarks of the phases, see benchRunner
 };
 
 
@@ -14,6 +14,7 @@
  * this program.  If not, see <http://www.gnu.org/licenses/>.                           *
  ****************************************************************************************/
 
+#include <algorithm>
 #include <iostream>
 
 #include "node.hpp"
@@ -33,16 +34,14 @@ void node_t::initialize(node_t *parent, u_char level, char position, const index
     m_flags = flUnset;
     m_childs = nullptr;
     m_point = point;
+    m_weight = 1;
+    m_neighbours.fill(nullptr);
     /*
     std::cerr << "this pos " << int(position)
               << " this index " << m_point->m_index[0]
               << " this level " << int(m_level)
               << std::endl;
     */
-
-    if(m_level == c_grid->m_level_max) {
-        assert(m_index == m_point->m_index);
-    }
 }
 /*!
    \brief node_t::getNeighbour
@@ -52,39 +51,111 @@ void node_t::initialize(node_t *parent, u_char level, char position, const index
    The implementation follows:
    https://github.com/dkolom/GALA2D/blob/master/QuadNode.cpp#L187
 */
-const node_t *node_t::getNeighbour(const char direction) const
+const node_t *node_t::getNeighbour(const char direction, size_t *calls) const
 {
-
-    static const std::array<char, 16> mm = {{
-                                             /*west  0*/ 1, 0, 3, 2,
-                                             /*east  1*/ 0, 1, 2, 3,
-                                             /*south 2*/ 2, 0, 3, 1,
-                                             /*north 3*/ 0, 2, 1, 3,
-                                            }};
+    if (calls) {
+        ++*calls;
+    }
 
     // Check the parent cell's children
     if (m_position == posRoot) {
         return this;
     }
 
-    const char off = direction*4; // offset
+    // position of the neighbour or of its counterpart in the neighbour of the parent
+    const char flipped = m_position ^ (1 << direction/2);
 
-    if (m_position == mm[off+0]) {
-        return m_parent->getChild(mm[off+1]);
-    }
-    if (m_position == mm[off+2]) {
-        return m_parent->getChild(mm[off+3]);
+    if (((m_position >> direction/2) & 1) != direction%2) {
+        return m_parent->getChild(flipped);
     }
 
-    const node_t* cnode = m_parent->getNeighbour(direction);
+    const node_t* cnode = m_parent->getNeighbour(direction, calls);
 
     if (cnode->isLeaf()) {
         return cnode;
     } else {
-        if (m_position == mm[off+1]) {
-            return cnode->getChild(mm[off+0]);
-        } else {
-            return cnode->getChild(mm[off+2]);
+        return cnode->getChild(flipped);
+    }
+}
+
+const node_t *node_t::getVisibleNeighbour(const char direction, const node_t *reader) const
+{
+    // same as getNeighbour()
+    if (m_position == posRoot) {
+        return this;
+    }
+
+    const char flipped = m_position ^ (1 << direction/2);
+
+    if (((m_position >> direction/2) & 1) != direction%2) {
+        return m_parent->getChild(flipped);
+    }
+
+    const node_t* cnode = m_parent->getVisibleNeighbour(direction, reader);
+
+    if (cnode->isLeaf() || (cnode->has(flBranched) && !depthFirst(cnode->m_parent, reader))) {
+        return cnode;
+    } else {
+        return cnode->getChild(flipped);
+    }
+}
+
+bool node_t::depthFirst(const node_t *a, const node_t *b)
+{
+    const u_char level = std::min(a->getLevel(), b->getLevel());
+    index_t index_a = a->getIndex();
+    index_t index_b = b->getIndex();
+    for (u_char dim = 0; dim < g_dimension; ++dim) {
+        index_a[dim] >>= a->getLevel() - level;
+        index_b[dim] >>= b->getLevel() - level;
+    }
+    if (index_a == index_b) {
+        // one is an ancestor of the other
+        return a->getLevel() > b->getLevel();
+    }
+
+    // the dimension whose index differs in the highest bit decides, the higher dimension on ties
+    u_char first = 0;
+    size_t highest = 0;
+    for (u_char dim = 0; dim < g_dimension; ++dim) {
+        const size_t differ = index_a[dim] ^ index_b[dim];
+        const bool lower = (differ < highest) && (differ < (differ ^ highest)); // lower leading bit
+        if (differ && !lower) {
+            first = dim;
+            highest = differ;
+        }
+    }
+    return index_a[first] < index_b[first];
+}
+
+void node_t::cacheNeighbours()
+{
+    if (m_position == posRoot) {
+        m_neighbours.fill(this);
+    } else {
+        // same as getNeighbour(), but the parent's neighbours are already known
+        for (char direction = 0; direction < g_orientations; ++direction) {
+            const char flipped = m_position ^ (1 << direction/2);
+            if (((m_position >> direction/2) & 1) != direction%2) {
+                m_neighbours[direction] = m_parent->getChild(flipped);
+            } else {
+                const node_t *cnode = m_parent->m_neighbours[direction];
+                if (cnode->isLeaf()) {
+                    m_neighbours[direction] = cnode;
+                } else {
+                    m_neighbours[direction] = cnode->getChild(flipped);
+                }
+            }
+        }
+    }
+}
+
+void node_t::updateWeight()
+{
+    m_weight = 1;
+    if (m_childs) {
+        for (const node_t &node: *m_childs) {
+            m_weight += node.m_weight;
         }
     }
 }
@@ -97,14 +168,13 @@ const point_t *node_t::getPoint(const index_t &index)
         return m_point;
     }
 
-    // const index_t &index_center = getChild(g_childs-1)->m_point->m_index;
-
-    // index offset to get in the center of the cell in finest level
-    const size_t offset = pow(2, c_grid->m_level_max - m_level);
+    // the point of the center child lies in the center of the cell in finest level
+    const index_t &index_center = getChild(g_childs-1)->m_point->m_index;
 
     char position = 0;
-    if (index[dimX] >= index_origin[dimX] + offset) position += 1;
-    if (g_dimension > 1 && (index[dimY] >= index_origin[dimY] + offset)) position += 2;
+    for (u_char dim = 0; dim < g_dimension; ++dim) {
+        if (index[dim] >= index_center[dim]) position += 1 << dim;
+    }
 
     return getChild(position)->getPoint(index);
 }
@@ -139,13 +209,15 @@ node_t::node_array_t *node_t::getChilds() const
 
    \note this function doesn't check if m_level_max is reached or not
 */
-void node_t::branch(size_t level)
+void node_t::branch(multires_grid_t &grid, size_t level)
 {
     if(level > 0) {
         // check if memory is not yet allocated in memory
         if(!m_childs) {
             // allocate memory for all child nodes
-            m_childs = new node_array_t;
+            m_childs = grid.m_node_pool.create(m_level+1);
+            grid.m_instrument.count(counterBranch);
+            size_t calls = 0; // of getNeighbour()
 
             for (size_t pos = 0; pos < g_childs; ++pos) {
                 // construct node index
@@ -158,22 +230,19 @@ void node_t::branch(size_t level)
                 if (pos > 0) {
                     // create new point for position > 0
                     index_t index_point = m_point->m_index;
-                    const size_t stepsize = pow(2, c_grid->m_level_max - (m_level+1));
+                    const size_t stepsize = pow(2, grid.m_level_max - (m_level+1));
                     const node_t *node_inter = this;
-                    if (pos % 2 == 1) {
-                        ++index_child[dimX];
-                        index_point[dimX] += stepsize;
-                        node_inter = node_inter->getNeighbour(posRight);
-                    }
-                    if (pos > 1) {
-                        ++index_child[dimY];
-                        index_point[dimY] += stepsize;
-                        node_inter = node_inter->getNeighbour(posTop);
+                    for (u_char dim = 0; dim < g_dimension; ++dim) {
+                        if (pos & (1 << dim)) {
+                            ++index_child[dim];
+                            index_point[dim] += stepsize;
+                            node_inter = node_inter->getNeighbour(orientation(dim, true), &calls);
+                        }
                     }
                     // phi-value interpolation
                     real phi = (m_point->m_phi + node_inter->getPoint()->m_phi)/2;
 
-                    point = new point_t(index_point, c_grid->m_level_max, phi);
+                    point = grid.m_point_pool.create(m_level+1, index_point, grid.m_level_max, phi);
                     getChild(pos)->setPoint(point);
                 } else {
                     // copy point for first child from parent (this)
@@ -181,21 +250,15 @@ void node_t::branch(size_t level)
                 }
 
                 getChild(pos)->initialize(this, m_level+1, position_t(pos), index_child, point);
+                assert(m_level+1 < grid.m_level_max || index_child == point->m_index);
             }
 
             // overwriting phi value for center cell
-            getChild(g_childs-1)->getPoint()->m_phi = interpolation();
-
-            // put new child nodes into the next-chain of the points
-            point_t *point = m_point->m_next;
-            for (short pos = g_childs-1; pos > 0; --pos) {
-                getChild(pos)->getPoint()->m_next = point;
-                point = getChild(pos)->getPoint();
-            }
-            this->getPoint()->m_next = point;
+            getChild(g_childs-1)->getPoint()->m_phi = interpolation(false, &calls);
+            grid.m_instrument.count(counterNeighbour, calls);
         }
         for (node_t &node: *m_childs) {
-            node.branch(level-1);
+            node.branch(grid, level-1);
         }
     }
 }
@@ -204,131 +267,148 @@ void node_t::branch(size_t level)
    \brief node_t::debranch
    \note check if m_childs is non-zero before
  */
-void node_t::debranch()
+void node_t::debranch(multires_grid_t &grid)
 {
-    point_t *point = (*m_childs)[g_childs-1].getPoint()->m_next;
-
-    delete m_childs;
+    grid.m_instrument.count(counterDebranch);
+    // the last child first, so the pools hand out the blocks in the order of the positions again
+    for (size_t pos = g_childs; pos-- > 0;) {
+        node_t &node = (*m_childs)[pos];
+        if (node.m_childs) {
+            node.debranch(grid);
+        }
+        // we delete the points except the one the first child got from its parent
+        if (node.m_position > position_t(0)) {
+            grid.m_point_pool.destroy(node.m_point, node.m_level);
+        }
+    }
+    grid.m_node_pool.destroy(m_childs, m_level+1);
     m_childs = nullptr;
-
-    m_point->m_next = point;
 }
 
 /*!
    \brief node_t::remesh_analyse
    \return if the current node has flag flActive
 */
-bool node_t::remesh_analyse()
+bool node_t::remesh_analyse(const multires_grid_t &grid)
 {
-    if (!has(flCached)) {
-        assert(!has(flActive));
+    unset(flActive);
+    unset(flPending);
 
-        // look for active childs
-        if (m_childs) {
-            for (node_t &node: *m_childs) {
-                if (node.remesh_analyse()) {
-                    set(flActive);
-                }
-            }
-        }
+    // respect minimum level
+    bool active = m_level <= grid.m_level_min;
 
-        // respect minimum level
-        if (m_level <= c_grid->m_level_min) {
-            set(flActive);
+    // look for active childs
+    if (!active && m_childs) {
+        for (const node_t &node: *m_childs) {
+            active = active || node.has(flActive);
         }
+    }
+
+    // check if the residual of this node
+    if (!active && (m_position == g_childs-1) && (residual() > grid.m_epsilon)) {
+        active = true;
+    }
 
-        // check if the residual of this node
-        if (!has(flActive) && (m_position == g_childs-1) && (residual() > c_epsilon)) {
-            set(flActive);
+    // check neighbours to keep the tree graded and the savety zone wide enough
+    if (!active) {
+        // check if the tree is balanced
+        for (u_char pos = 0; pos < g_orientations; ++pos) {
+            assert(abs(getCachedNeighbour(pos)->getLevel() - m_level) < 2);
         }
 
-        // check neighbours to keep the tree graded
-        if (!has(flActive)) {
-            /* If there is only one neighbour of my level that has children,
-               this node has to stay active.
-            */
-
-            for (u_char pos = 0; pos < g_childs; ++pos) {
-                const node_t *neighbour = getNeighbour(pos);
-
-                // check if the tree is balanced
-                assert(abs(neighbour->getLevel() - m_level) < 2);
-
-                if ((neighbour->getLevel() == m_level) && neighbour->getChilds()) {
-                    u_char flags = m_flags; // members are not supported by openmp
-                    #pragma omp parallel for reduction(| : flags) if (m_level < g_level_fork)
-                    for (auto node = neighbour->getChilds()->begin(); node < neighbour->getChilds()->end(); ++node) {
-                        if (node->remesh_analyse()) {
-                            flags = flags | flActive;
-                            // break; (not compatible with openmp)
-                        }
-                    }
-                    setFlags(flags);
+        /* If there is only one node of my level within the zone that has an
+           active child, this node has to stay active.
+        */
+        forEachInZone(grid.m_zone_width[m_level], [&active](const node_t *neighbour) {
+            if (!active && neighbour->getChilds()) {
+                for (const node_t &node: *neighbour->getChilds()) {
+                    active = active || node.has(flActive);
                 }
             }
-        }
-
-        set(flCached);
+        });
     }
 
-    return has(flActive);
+    if (active) {
+        set(flActive);
+    }
+    return active;
 }
 
 /*!
    \brief node_t::remesh_savety adds savety zone
 
-   This methods walks recursively through the whole tree to find the nodes
-   with highest level in each branch which have a flActive flag set and creates
-   child nodes (if neccessary) with flSavetyZone flag set.
-
    Ok, we do it differently. We just branch every node which has the flActive flag
    itself or has a sibling with it.
 */
-void node_t::remesh_savety()
+bool node_t::remesh_savety(multires_grid_t &grid)
 {
-    if (m_childs && (m_level+1 < c_grid->m_level_max)) {
+    bool branched = false;
+    if (m_childs && (m_level+1 < grid.m_level_max)) {
         // cumulative  flags of children
         u_char cum_flags = flUnset;
-        #pragma omp parallel for reduction(| : cum_flags) if (m_level < g_level_fork)
-        for (auto node = m_childs->begin(); node < m_childs->end(); ++node) {
-            node->remesh_savety();
-            cum_flags = cum_flags | node->getFlags();
+        for (const node_t &node: *m_childs) {
+            cum_flags = cum_flags | node.getFlags();
         }
         if (cum_flags & flActive) {
             for (node_t &node: *m_childs) {
-                node.branch();
+                if (node.isLeaf()) {
+                    node.branch(grid);
+                    node.set(flBranched);
+                    branched = true;
+                }
                 for (node_t &node_child: *node.getChilds()) {
                     node_child.set(flSavetyZone);
                 }
             }
+        } else {
+            // flags of earlier calls, see remesh_clean()
+            for (node_t &node: *m_childs) {
+                if (node.getChilds()) {
+                    for (node_t &node_child: *node.getChilds()) {
+                        node_child.unset(flSavetyZone);
+                    }
+                }
+            }
         }
     }
+    return branched;
 }
 
 /*!
    \brief node_t::remesh_clean
    \return if the current node has no children
 */
-bool node_t::remesh_clean()
+bool node_t::remesh_clean(multires_grid_t &grid, const bool reset)
 {
     bool veto = false; // veto for removal of this node
     if (m_childs) {
-        #pragma omp parallel for reduction(|| : veto) if (m_level < g_level_fork)
-        for (auto node = m_childs->begin(); node < m_childs->end(); ++node) {
-            if (!node->remesh_clean()) {
-                veto = veto || true;
+        std::array<bool, g_childs> removable;
+        for (u_char pos = 0; pos < g_childs; ++pos) {
+            node_t *node = getChild(pos);
+            if (node->m_weight > c_task_weight) {
+                // large subtrees are cleaned by any thread of the team
+                #pragma omp task shared(removable, grid)
+                removable[pos] = node->remesh_clean(grid, reset);
+            } else {
+                removable[pos] = node->remesh_clean(grid, reset);
             }
         }
+        #pragma omp taskwait
+        for (const bool r: removable) {
+            veto = veto || !r;
+        }
         if (!veto) {
-            debranch();
+            debranch(grid);
         }
     }
-    bool ret = (!veto && (m_flags < flSavetyZone));
-    m_flags = flUnset;
+    bool ret = (!veto && !has(flSavetyZone) && !has(flActive));
+    if (reset) {
+        m_flags = flUnset;
+    }
     return ret;
 }
 
-real node_t::interpolation() const
+real node_t::interpolation(const bool cached, size_t *calls) const
 {
     /*
     real phi = 0;
@@ -343,11 +423,11 @@ real node_t::interpolation() const
     real phi = m_point->m_phi;
     for (size_t pos = 1; pos < g_childs; ++pos) {
         const node_t *node_inter = this;
-        if (pos % 2 == 1) {
-            node_inter = node_inter->getNeighbour(posRight);
-        }
-        if (pos > 1) {
-            node_inter = node_inter->getNeighbour(posTop);
+        for (u_char dim = 0; dim < g_dimension; ++dim) {
+            if (pos & (1 << dim)) {
+                node_inter = cached ? node_inter->getCachedNeighbour(orientation(dim, true))
+                                    : node_inter->getNeighbour(orientation(dim, true), calls);
+            }
         }
         // phi-value interpolation
         phi += node_inter->getPoint()->m_phi;
@@ -356,105 +436,98 @@ real node_t::interpolation() const
     return phi/g_childs;
 }
 
-real node_t::residual() const
-{
-    assert(m_position == g_childs-1);
-    return fabs(m_point->m_phi - m_parent->interpolation());
-}
-
-void node_t::updateFlow(const char direction)
+void node_t::reinterpolate(const node_t *reader)
 {
-    if(isLeaf()) {
-        const real phi_this = m_point->m_phi;
-
-        std::array<real,  g_childs> phi_neighbour;
-        // u_char level_diff_max = 0;
-        for (char pos = 0; pos < g_childs; ++pos) {
-            const node_t *neighbour = getNeighbour(pos);
-            /* as we work with graded trees, we can expect that the level of our
-               neighbours is either the same or one level smaller (coarser).
-            */
-            assert(abs(neighbour->getLevel() - m_level) < 2);
-            real phi = neighbour->getPoint()->m_phi;
-            if (neighbour->getLevel() < m_level) {
-                // if the left neighour cell in coarser, we have to interpolate
-                // its value to be comparable with the other values
-                phi = (phi+phi_this)/2;
-
-            } else if (neighbour->getChilds()) {
-                // the left neighbour is finer!
-                assert(g_dimension < 3);
-                static const std::array<u_char, 8> faces = {{ /*W(0)*/ 1, 3, /*E(1)*/ 0, 2, /*S(2)*/ 2, 3, /*N(3)*/ 0, 1}};
-                for (u_char face_pos = direction; face_pos < pow(2, g_dimension-1); ++face_pos) {
-                    phi = neighbour->getChild(faces[face_pos])->getPoint()->m_phi;
-                    phi = 2*phi-phi_this; // extrapolating
-                }
+    assert(m_childs);
+    // the same sums as in branch() and interpolation()
+    real phi_center = m_point->m_phi;
+    for (size_t pos = 1; pos < g_childs; ++pos) {
+        const node_t *node_inter = this;
+        for (u_char dim = 0; dim < g_dimension; ++dim) {
+            if (pos & (1 << dim)) {
+                node_inter = node_inter->getVisibleNeighbour(orientation(dim, true), reader);
             }
-            phi_neighbour[pos] = phi;
-        }
-
-        const real dx = g_span[dimX]/(1 << m_level);
-
-        m_point->m_flow = flowHelper(phi_this, phi_neighbour[direction-1], phi_neighbour[direction], dx, c_grid->dt);
-    } else {
-        #pragma omp parallel for if (m_level < g_level_fork)
-        for (auto node = m_childs->begin(); node < m_childs->end(); ++node) {
-            node->updateFlow(direction);
         }
+        getChild(pos)->getPoint()->m_phi = (m_point->m_phi + node_inter->getPoint()->m_phi)/2;
+        phi_center += node_inter->getPoint()->m_phi;
     }
+    getChild(g_childs-1)->getPoint()->m_phi = phi_center/g_childs;
+}
+
+real node_t::residual() const
+{
+    assert(m_position == g_childs-1);
+    // residual() is only called during remesh_analyse() while the tree is unchanged
+    return fabs(m_point->m_phi - m_parent->interpolation(true));
 }
 
-void node_t::timeStep(const char direction)
+template<bool limiter>
+void node_t::updateFlow(const char direction, const real dt)
 {
-    if(isLeaf()) {
-        const real flow_this = m_point->m_flow;
+    assert(isLeaf());
+
+    const real phi_this = m_point->m_phi;
 
-        real flow_income = 0;
-        // u_char level_diff_max = 0;
-        const node_t *neighbour = getNeighbour(direction-1);
+    std::array<real,  g_orientations> phi_neighbour;
+    // u_char level_diff_max = 0;
+    for (char pos = 0; pos < g_orientations; ++pos) {
+        const node_t *neighbour = getCachedNeighbour(pos);
         /* as we work with graded trees, we can expect that the level of our
            neighbours is either the same or one level smaller (coarser).
         */
         assert(abs(neighbour->getLevel() - m_level) < 2);
-        constexpr u_char dimensionFactor = 1 << (g_dimension - 1);
-        if (neighbour->getLevel() == m_level){
-            flow_income = neighbour->getPoint()->m_flow;
-        } else if (neighbour->getLevel() < m_level) {
-            // assert(m_position == 0);
+        real phi = neighbour->getPoint()->m_phi;
+        if (neighbour->getLevel() < m_level) {
             // if the left neighour cell in coarser, we have to interpolate
             // its value to be comparable with the other values
-            flow_income = neighbour->getPoint()->m_flow/dimensionFactor; // *2
-        }  else {
-            // gather flow from children
-            for (u_char pos = 0; pos < g_dimension; ++pos) {
-                flow_income += neighbour->getChild(direction+pos*2)->getPoint()->m_flow; // /2
-            }
-        }
-
-        flow_income = neighbour->getPoint()->m_flow;
-        const real dx = g_span[dimX]/(1 << m_level);
+            phi = (phi+phi_this)/2;
 
-        m_point->m_phi += timeStepHelperFlow(flow_this, flow_income, dx, c_grid->dt);
-    } else {
-        #pragma omp parallel for if (m_level < g_level_fork)
-        for (auto node = m_childs->begin(); node < m_childs->end(); ++node) {
-            node->timeStep(direction);
+        } else if (neighbour->getChilds() && direction == posRight) {
+            // the left neighbour is finer! extrapolating from its center in x-direction only
+            phi = neighbour->getChild(g_childs-1)->getPoint()->m_phi;
+            phi = 2*phi-phi_this; // extrapolating
         }
+        phi_neighbour[pos] = phi;
     }
+
+    const real dx = g_span[direction/2]/(1 << m_level);
+
+    m_point->m_flow = flowHelper<limiter>(phi_this, phi_neighbour[direction-1], phi_neighbour[direction], dx, dt);
 }
 
-node_t::~node_t()
+template void node_t::updateFlow<false>(const char direction, const real dt);
+template void node_t::updateFlow<true>(const char direction, const real dt);
+
+void node_t::timeStep(const char direction, const real dt)
 {
-    if (m_childs) {
-        debranch();
-    }
+    assert(isLeaf());
 
-    // we delete the position pointers except the one we got from parent
-    if(m_position > position_t(0)) {
-        delete m_point;
-        // m_point = nullptr;
+    const real flow_this = m_point->m_flow;
+
+    real flow_income = 0;
+    // u_char level_diff_max = 0;
+    const node_t *neighbour = getCachedNeighbour(direction-1);
+    /* as we work with graded trees, we can expect that the level of our
+       neighbours is either the same or one level smaller (coarser).
+    */
+    assert(abs(neighbour->getLevel() - m_level) < 2);
+    constexpr u_char dimensionFactor = 1 << (g_dimension - 1);
+    if (neighbour->getLevel() == m_level){
+        flow_income = neighbour->getPoint()->m_flow;
+    } else if (neighbour->getLevel() < m_level) {
+        // assert(m_position == 0);
+        // if the left neighour cell in coarser, we have to interpolate
+        // its value to be comparable with the other values
+        flow_income = neighbour->getPoint()->m_flow/dimensionFactor; // *2
+    }  else {
+        // gather flow from children
+        for (u_char pos = 0; pos < g_childs/2; ++pos) {
+            flow_income += neighbour->getChild(facingChild(direction-1, pos))->getPoint()->m_flow; // /2
+        }
     }
-}
 
-multires_grid_t *node_t::c_grid = nullptr;
-real node_t::c_epsilon = 0;
+    flow_income = neighbour->getPoint()->m_flow;
+    const real dx = g_span[direction/2]/(1 << m_level);
+
+    m_point->m_phi += timeStepHelperFlow(flow_this, flow_income, dx, dt);
+}
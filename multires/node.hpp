@@ -26,6 +26,11 @@ class point_t;
 
 /*!
    \brief The node_t class is the base object the multi resolution tree is build upon providing the core functionality
+
+   A node does not know its grid. The functions which allocate or free nodes
+   and points or which depend on the parameters of the grid take the
+   multires_grid_t as argument, so several grids are independent of each other
+   without a pointer per node.
  */
 class node_t
 {
@@ -52,7 +57,10 @@ public:
        what gives you the place in one cell. Orientation is the perspective
        if you want to query for neighbouring cells.
 
-
+       In any dimension, bit `d` of a position is set for the upper half of
+       the cell in dimension `d`, and the orientation `2*d` (`2*d+1`) looks
+       to the lower (upper) neighbour in dimension `d`, see orientation().
+       So the last position `g_childs-1` is always the center of the cell.
      */
     enum position_t {
         // according to numbering of quadrants, starting with 0
@@ -72,8 +80,33 @@ public:
         , posSE = 1
         , posNW = 2
         , posNE = 3
+        // 3D extension, orientations only
+        , posDown             = 4
+        , posUp               = 5
     };
 
+    /*!
+       \brief orientation gives the orientation to a neighbour
+       \param dimension to look along
+       \param upper looks to the upper instead of the lower neighbour
+       \return orientation
+     */
+    static constexpr char orientation(const u_char dimension, const bool upper)
+    { return 2*dimension + upper; }
+
+    /*!
+       \brief facingChild gives the children of the neighbour in an orientation which touch a node
+       \param orientation of the neighbour
+       \param i number of the child, less than `g_childs/2`
+       \return position of the child in the neighbour
+     */
+    static constexpr char facingChild(const char orientation, const u_char i)
+    {
+        return (i & ((1 << orientation/2) - 1))          // lower dimensions
+             | ((i >> orientation/2) << (orientation/2+1)) // upper dimensions
+             | ((1 - orientation%2) << orientation/2);    // side towards the node
+    }
+
     enum level_t {
           lvlNoChilds =  0
         , lvlRoot     =  0
@@ -88,6 +121,9 @@ public:
         , flVirtual    = 1 << 2
         , flSavetyZone = 1 << 3
         , flActive     = 1 << 4
+        , flDebranch   = 1 << 5 //!< children are removed by multires_grid_t::remeshIncremental()
+        , flPending    = 1 << 6 //!< to be analysed by multires_grid_t::remeshIncremental()
+        , flBranched   = 1 << 7 //!< children were created by the running multires_grid_t::remeshSavety()
     };
 
     /*!
@@ -106,25 +142,16 @@ public:
     { m_flags = m_flags | flag; }
 
     /*!
-       \brief node_t constructor used for default-construction by std containers
-     */
-    node_t();
-
-    /*!
-       \brief setGrid sets the corresponding grid for all nodes in the grid (class/static function!)
-       \param grid
+       \brief unset clears a specific flag for this node
+       \param flag
      */
-    static void setGrid(multires_grid_t *grid)
-    { c_grid = grid; }
+    inline void unset(flag_t flag)
+    { m_flags = m_flags & ~flag; }
 
     /*!
-       \brief setEpsilon sets the epsilon used by all nodes in the grid
-       \param epsilon
-
-       \sa g_epsilon
+       \brief node_t constructor used for default-construction by std containers
      */
-    static void setEpsilon(real epsilon)
-    { c_epsilon = epsilon; }
+    node_t();
 
     /*!
        \brief initialize is actually the setup function of this object
@@ -145,12 +172,80 @@ public:
     /*!
        \brief getNeighbour gets you the neighbour in the direction/orientation relative to this node
        \param orientation
+       \param calls is incremented for this call and each recursion unless it is nullptr, see \ref counterNeighbour
        \return pointer to neighbouring node
 
        This function uses recursion and might be computational expensive.
        Worst case is probably: log(number of nodes)
      */
-    const node_t *getNeighbour(const char orientation) const;
+    const node_t *getNeighbour(const char orientation, size_t *calls = nullptr) const;
+
+    /*!
+       \brief getVisibleNeighbour is getNeighbour() on the tree as remesh_savety() would have left it before reader
+       \param orientation
+       \param reader node whose children are branched
+       \return pointer to neighbouring node
+
+       The children of nodes with the flag flBranched count only if their
+       parent comes before reader in the order of depthFirst().
+     */
+    const node_t *getVisibleNeighbour(const char orientation, const node_t *reader) const;
+
+    /*!
+       \brief depthFirst is true if a comes before b in the depth first order of the tree
+
+       The subtree of a node comes before the node and the children in the
+       order of their positions, i.e. in Morton order with dimX as lowest bit.
+       The savety zone is defined by branching the nodes in this order.
+     */
+    static bool depthFirst(const node_t *a, const node_t *b);
+
+    /*!
+       \brief getCachedNeighbour gets you the neighbour as found by the last call of cacheNeighbours()
+       \param orientation
+       \return pointer to neighbouring node
+
+       The result equals getNeighbour() as long as the tree has not been altered
+       since cacheNeighbours(). It is used by the stencil functions to avoid the
+       recursion in getNeighbour().
+     */
+    inline const node_t *getCachedNeighbour(const char orientation) const
+    { return m_neighbours[orientation]; }
+
+    /*!
+       \brief forEachInZone calls f for the other nodes of the same level within radius steps along the cached neighbours
+       \param radius number of steps, 1 gives the direct neighbours
+       \param f is called with a const node_t pointer
+       \param transposed steps along the dimensions from the last to the first one
+
+       The zone consists of the nodes within radius steps in all dimensions
+       together, which are walked dimension by dimension starting with x. A path
+       ends at the first node of another level. With transposed set, f is
+       called for the nodes which have this node in their zone.
+     */
+    template<typename F>
+    void forEachInZone(const u_char radius, F f, const bool transposed = false) const;
+
+    /*!
+       \brief cacheNeighbours stores the neighbours of this node
+
+       The neighbours are derived from the cached neighbours of the parent, so
+       the whole tree is done in linear time if it is cached level by level
+       starting with the root node, see multires_grid_t::updateTopology().
+     */
+    void cacheNeighbours();
+
+    /*!
+       \brief updateWeight sets the number of nodes of the subtree of this node
+
+       The weights of the children have to be up to date.
+     */
+    void updateWeight();
+
+    //! number of nodes of the subtree of this node as of the last updateWeight()
+    inline u_int getWeight() const
+    { return m_weight; }
+
     const node_t *getParent() const
     { return m_parent; }
     /*!
@@ -199,38 +294,62 @@ public:
 
     /*!
        \brief branch creates adds level more generations of children
+       \param grid provides the pools for the children and their points
        \param level
      */
-    void branch(size_t level = 1);
+    void branch(multires_grid_t &grid, size_t level = 1);
 
     /*!
-       \brief debranch removes the children from memory while keeping the linked list of all points in good order
+       \brief debranch removes the children and their subtrees from memory
+       \param grid whose pools take the children and their points back
      */
-    void debranch();
+    void debranch(multires_grid_t &grid);
 
     /*!
-       \brief remesh_analyse recursively sets the approiate flags for all child nodes
+       \brief remesh_analyse sets the flag **active** of this node
        \return if this node got the flag **active** set
+
+       The children of this node and the children of its neighbours have to be
+       analysed before, so multires_grid_t::remesh() calls it level by level
+       starting with the finest level. The flags **active** and **pending** of
+       an earlier analysis are replaced.
      */
-    bool remesh_analyse();
+    bool remesh_analyse(const multires_grid_t &grid);
 
     /*!
        \brief remesh_savety makes sure that all child nodes with flActive flag set have children with flSavetyZone flag set
+       \return if children were branched, they got the flag flBranched
+
+       The nodes are done level by level starting with the finest one, see
+       multires_grid_t::remeshSavety(). If no child is active, the
+       flSavetyZone flags of the grandchildren are cleared.
+     */
+    bool remesh_savety(multires_grid_t &grid);
+
+    /*!
+       \brief reinterpolate sets the points of the children again as branch() does
+       \param reader whose view of the tree is taken, see getVisibleNeighbour()
      */
-    void remesh_savety();
+    void reinterpolate(const node_t *reader);
 
     /*!
-       \brief remesh_clean removes all nodes from this grid which have not the flActive nor the flSavetyZone flag set
+       \brief remesh_clean recursively removes all nodes from this grid which have not the flActive nor the flSavetyZone flag set
+       \param reset clears the flags of the remaining nodes
        \return if this node can be deleted by its parent
+
+       Subtrees with more than \ref c_task_weight nodes are cleaned in OpenMP
+       tasks, so call it inside of a parallel region to spread the work.
      */
-    bool remesh_clean();
+    bool remesh_clean(multires_grid_t &grid, const bool reset = true);
 
 
     /*!
        \brief interpolation
+       \param cached uses getCachedNeighbour() instead of getNeighbour() if true
+       \param calls counts the calls of getNeighbour() unless it is nullptr
        \return field value for the center position of this node
      */
-    real interpolation() const;
+    real interpolation(const bool cached = false, size_t *calls = nullptr) const;
     /*!
        \brief residual
        \return difference between the interpolated center of its parent and the current value of this node
@@ -240,20 +359,24 @@ public:
     inline real residual() const;
 
     /*!
-       \brief updateFlow works recursively to update the flux in one direction of all child nodes
+       \brief updateFlow updates the flux of this leaf in one direction
+       \tparam limiter see flowHelper<limiter>()
        \param direction
+       \param dt time step of the grid
 
-       \sa flowHelper()
+       \sa multires_grid_t::sweep()
      */
-    void updateFlow(const char direction = posRight);
+    template<bool limiter>
+    void updateFlow(const char direction, const real dt);
 
     /*!
-       \brief timeStep performs the actual time step using the flux values which have been computed before
+       \brief timeStep performs the actual time step of this leaf using the flux values which have been computed before
        \param direction
+       \param dt time step of the grid
 
-       \sa updateFlow(), timeStepHelperFlow()
+       \sa updateFlow(), timeStepHelperFlow(), multires_grid_t::sweep()
      */
-    void timeStep(const char direction = posRight);
+    void timeStep(const char direction, const real dt);
 
     inline u_char getLevel() const
     { return m_level; }
@@ -276,19 +399,59 @@ public:
     const index_t &getIndex() const
     { return m_index; }
 
-    ~node_t();
-
 private:
     node_t *m_parent; //!< parent node
     u_char m_level; //!< level of this node
     char m_position; //!< position of this node relative to parent
     index_t m_index; //!< index at m_level
     u_char m_flags; //!< bunch of flags of this node
+    u_int m_weight; //!< number of nodes of the subtree, see updateWeight()
+    u_int m_leaf; //!< index in multires_grid_t::m_leaves, only valid for leaves
     // std::unique_ptr<point_t> m_point;
     point_t *m_point; //!< corresponding point of this node
     node_array_t *m_childs; //!< children of this node, might be null (0)
-    static multires_grid_t *c_grid; //!< static pointer to multires_grid_t
-    static real c_epsilon; //!< epsilon, see \ref g_epsilon
+    std::array<const node_t *, g_orientations> m_neighbours; //!< neighbours per orientation, see cacheNeighbours()
+    static const u_int c_task_weight = 256; //!< minimal number of nodes of a subtree to be processed in a separate task
+
+    /*!
+       \brief walkZone is the recursion of forEachInZone() over the dimensions
+       \param step number of dimensions walked before
+       \param radius number of steps left
+       \param origin is true as long as the path did not leave the node of forEachInZone()
+     */
+    template<typename F>
+    void walkZone(const u_char step, const int radius, const bool origin, F &f, const bool transposed) const;
+
+    friend class multires_grid_t;
 };
 
+template<typename F>
+void node_t::forEachInZone(const u_char radius, F f, const bool transposed) const
+{
+    walkZone(0, radius, true, f, transposed);
+}
+
+template<typename F>
+void node_t::walkZone(const u_char step, const int radius, const bool origin, F &f, const bool transposed) const
+{
+    if (step == g_dimension) {
+        if (!origin) {
+            f(this);
+        }
+        return;
+    }
+    const u_char dimension = transposed ? g_dimension-1-step : step;
+    walkZone(step+1, radius, origin, f, transposed);
+    for (u_char upper = 0; upper < 2; ++upper) {
+        const node_t *node = this;
+        for (int i = 1; i <= radius; ++i) {
+            node = node->getCachedNeighbour(orientation(dimension, upper));
+            if (node->m_level != m_level) {
+                break;
+            }
+            node->walkZone(step+1, radius-i, false, f, transposed);
+        }
+    }
+}
+
 #endif // NODE_HPP
@@ -0,0 +1,319 @@
+/***************************************************************************************
+ * Copyright (c) 2014 Robert Riemann <robert@riemann.cc>                                *
+ *                                                                                      *
+ * This program is free software; you can redistribute it and/or modify it under        *
+ * the terms of the GNU General Public License as published by the Free Software        *
+ * Foundation; either version 2 of the License, or (at your option) any later           *
+ * version.                                                                             *
+ *                                                                                      *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY      *
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A      *
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.             *
+ *                                                                                      *
+ * You should have received a copy of the GNU General Public License along with         *
+ * this program.  If not, see <http://www.gnu.org/licenses/>.                           *
+ ****************************************************************************************/
+
+#ifndef POOL_HPP
+#define POOL_HPP
+
+#include <new>
+#include <algorithm>
+#include <mutex>
+#include <vector>
+#include <utility>
+
+#include "settings.h"
+
+/*!
+   \brief The pool_t class is a level-aware slab allocator for objects of the multi resolution tree
+
+   Memory is reserved in slabs of \ref m_slab_size blocks. Every tree level has
+   its own slab and its own free list, so that nodes of the same level stay close
+   to each other in memory and blocks released by node_t::debranch() are handed
+   out again by the next node_t::branch() on the same level instead of going
+   back to the heap. Slabs are only given back when the pool is destroyed.
+
+   create() and destroy() are called from within openmp loops by the remesh
+   functions of node_t. Every openmp thread therefore keeps its own free lists
+   and only locks the shared lists to move \ref c_batch blocks at once into or
+   out of its cache. Concurrent callers have to be threads of the same team, as
+   the caches are indexed by omp_get_thread_num(); threads beyond the number of
+   caches use the shared lists directly.
+ */
+template<typename T>
+class pool_t
+{
+public:
+    /*!
+       \brief The statistics_t struct summarises the usage of a pool to help sizing it
+     */
+    struct statistics_t {
+        size_t live;     //!< number of blocks currently in use
+        size_t peak;     //!< maximum number of blocks in use or held by the thread caches at the same time
+        size_t recycled; //!< number of allocations served from a free list
+        size_t capacity; //!< number of blocks reserved in slabs
+        size_t slabs;    //!< number of slabs requested from the heap
+    };
+
+    static constexpr size_t c_batch = 32; //!< number of blocks moved at once between the shared lists and a thread cache
+
+    /*!
+       \brief pool_t constructs an empty pool
+       \param slab_size number of blocks reserved at once per level
+     */
+    explicit pool_t(size_t slab_size = 256) :
+        m_slab_size(slab_size)
+      , m_caches(maxThreads())
+      , m_outstanding(0)
+      , m_statistics({0, 0, 0, 0, 0})
+    {
+        assert(m_slab_size > 0);
+    }
+
+    ~pool_t()
+    {
+        for (void *slab: m_slabs) {
+            ::operator delete(slab);
+        }
+    }
+
+    /*!
+       \brief create constructs a new object in a block of the given level
+       \param level the object belongs to
+       \param args are forwarded to the constructor of T
+       \return pointer to the new object
+     */
+    template<typename... Args>
+    T *create(const u_char level, Args&&... args)
+    {
+        const size_t thread = threadNumber();
+        void *block;
+        if (thread < m_caches.size()) {
+            block = m_caches[thread].take(*this, level);
+        } else {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            block = allocate(level);
+        }
+        return new (block) T(std::forward<Args>(args)...);
+    }
+
+    /*!
+       \brief destroy destructs object and keeps its block for the next create() on this level
+       \param object has to be created by this pool
+       \param level has to be the same as passed to create()
+     */
+    void destroy(T *object, const u_char level)
+    {
+        object->~T();
+
+        const size_t thread = threadNumber();
+        if (thread < m_caches.size()) {
+            m_caches[thread].give(*this, object, level);
+        } else {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            level_t &lvl = m_levels[level];
+            push(lvl.free, object);
+            --m_statistics.live;
+            --m_outstanding;
+        }
+    }
+
+    /*!
+       \brief statistics gives a snapshot of the usage counters
+
+       It must not be called while other threads create or destroy objects.
+     */
+    statistics_t statistics() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        statistics_t statistics = m_statistics;
+        for (const cache_t &cache: m_caches) {
+            statistics.live     += cache.created - cache.destroyed;
+            statistics.recycled += cache.recycled;
+        }
+        return statistics;
+    }
+
+private:
+    pool_t(const pool_t&) = delete; // remove copy constructor
+
+    /*!
+       \brief The level_t struct keeps the free list and the current slab of one level
+     */
+    struct level_t {
+        level_t() : free(nullptr), next(nullptr), end(nullptr), count(0) {}
+        void *free;   //!< head of the intrusive list of released blocks
+        T *next;      //!< next untouched block in the current slab
+        T *end;       //!< end of the current slab
+        size_t count; //!< number of blocks in the free list, only kept by the thread caches
+    };
+
+    /*!
+       \brief The cache_t struct holds the blocks of one thread, padded to multiples of a cache line
+     */
+    struct cache_t {
+        std::vector<level_t> levels; //!< free lists and slab parts indexed by tree level
+        size_t created = 0;   //!< number of objects created by this thread
+        size_t destroyed = 0; //!< number of objects destroyed by this thread
+        size_t recycled = 0;  //!< number of creations served from the free list
+        char padding[64 - (sizeof(levels) + 3*sizeof(size_t)) % 64];
+
+        //! gives a block of the level, refills the cache from the shared lists when empty
+        void *take(pool_t &pool, const u_char level)
+        {
+            if (level >= levels.size()) {
+                levels.resize(level+1);
+            }
+            level_t &lvl = levels[level];
+
+            ++created;
+            if (!lvl.free && lvl.next == lvl.end) {
+                std::lock_guard<std::mutex> lock(pool.m_mutex);
+                pool.refill(lvl, level);
+            }
+            if (lvl.free) {
+                ++recycled;
+                --lvl.count;
+                return pop(lvl.free);
+            }
+            return lvl.next++;
+        }
+
+        //! keeps a released block, hands a batch back to the shared lists if the cache grows too large
+        void give(pool_t &pool, void *block, const u_char level)
+        {
+            if (level >= levels.size()) {
+                levels.resize(level+1);
+            }
+            level_t &lvl = levels[level];
+
+            ++destroyed;
+            push(lvl.free, block);
+            if (++lvl.count >= 2*c_batch) {
+                void *first = lvl.free;
+                void *last  = first;
+                for (size_t i = 1; i < c_batch; ++i) {
+                    last = *reinterpret_cast<void **>(last);
+                }
+                lvl.free = *reinterpret_cast<void **>(last);
+                lvl.count -= c_batch;
+
+                std::lock_guard<std::mutex> lock(pool.m_mutex);
+                level_t &shared = pool.m_levels[level];
+                *reinterpret_cast<void **>(last) = shared.free;
+                shared.free = first;
+                pool.m_outstanding -= c_batch;
+            }
+        }
+    };
+
+    static_assert(sizeof(T) >= sizeof(void *), "blocks have to be able to keep the free list pointer");
+
+    static void push(void *&list, void *block)
+    {
+        *reinterpret_cast<void **>(block) = list;
+        list = block;
+    }
+
+    static void *pop(void *&list)
+    {
+        void *block = list;
+        list = *reinterpret_cast<void **>(block);
+        return block;
+    }
+
+    //! makes sure there is an untouched block in the current slab of the level
+    level_t &reserve(const u_char level)
+    {
+        if (level >= m_levels.size()) {
+            m_levels.resize(level+1);
+        }
+        level_t &lvl = m_levels[level];
+
+        if (!lvl.free && lvl.next == lvl.end) {
+            lvl.next = static_cast<T *>(::operator new(sizeof(T)*m_slab_size));
+            lvl.end  = lvl.next + m_slab_size;
+            m_slabs.push_back(lvl.next);
+            m_statistics.capacity += m_slab_size;
+            ++m_statistics.slabs;
+        }
+        return lvl;
+    }
+
+    //! moves up to c_batch released blocks, or else untouched blocks, of the level into a thread cache
+    void refill(level_t &cache, const u_char level)
+    {
+        level_t &lvl = reserve(level);
+
+        size_t count = 0;
+        if (lvl.free) {
+            while (lvl.free && count < c_batch) {
+                push(cache.free, pop(lvl.free));
+                ++count;
+            }
+            cache.count += count;
+        } else {
+            count = std::min<size_t>(c_batch, lvl.end - lvl.next);
+            cache.next = lvl.next;
+            cache.end  = lvl.next + count;
+            lvl.next  += count;
+        }
+
+        m_outstanding += count;
+        if (m_outstanding > m_statistics.peak) {
+            m_statistics.peak = m_outstanding;
+        }
+    }
+
+    //! gives a single block of the level from the shared lists
+    void *allocate(const u_char level)
+    {
+        level_t &lvl = reserve(level);
+
+        void *block;
+        if (lvl.free) {
+            block = pop(lvl.free);
+            ++m_statistics.recycled;
+        } else {
+            block = lvl.next++;
+        }
+
+        ++m_statistics.live;
+        if (++m_outstanding > m_statistics.peak) {
+            m_statistics.peak = m_outstanding;
+        }
+        return block;
+    }
+
+    static size_t threadNumber()
+    {
+        #ifdef _OPENMP
+        return omp_get_thread_num();
+        #else
+        return 0;
+        #endif
+    }
+
+    static size_t maxThreads()
+    {
+        #ifdef _OPENMP
+        return omp_get_max_threads();
+        #else
+        return 1;
+        #endif
+    }
+
+    const size_t m_slab_size;     //!< number of blocks per slab
+    std::vector<cache_t> m_caches; //!< free lists of the openmp threads
+    std::vector<level_t> m_levels; //!< shared free lists and slabs indexed by tree level
+    std::vector<void *> m_slabs;   //!< all slabs to release them at destruction
+    size_t m_outstanding;          //!< number of blocks in use or held by the thread caches
+    statistics_t m_statistics;     //!< usage counters of the shared lists
+    mutable std::mutex m_mutex;    //!< protects the shared lists and counters
+};
+
+template<typename T>
+constexpr size_t pool_t<T>::c_batch;
+
+#endif // POOL_HPP
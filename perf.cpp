@@ -0,0 +1,202 @@
+/***************************************************************************************
+ * Copyright (c) 2014 Robert Riemann <robert@riemann.cc>                                *
+ *                                                                                      *
+ * This program is free software; you can redistribute it and/or modify it under        *
+ * the terms of the GNU General Public License as published by the Free Software        *
+ * Foundation; either version 2 of the License, or (at your option) any later           *
+ * version.                                                                             *
+ *                                                                                      *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY      *
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A      *
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.             *
+ *                                                                                      *
+ * You should have received a copy of the GNU General Public License along with         *
+ * this program.  If not, see <http://www.gnu.org/licenses/>.                           *
+ ****************************************************************************************/
+
+#include <cstring>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#include "perf.hpp"
+
+namespace {
+
+//! names of perf_counter_t
+const char *const c_names[perfCount] = {
+    "cycles", "instructions", "l1d_misses", "llc_misses", "branch_misses"
+};
+
+#ifdef __linux__
+/*!
+   \brief The event_t struct selects a counter of perf_event_open
+ */
+struct event_t {
+    uint32_t type;
+    uint64_t config;
+};
+
+//! read misses of a cache, see perf_event_open(2)
+constexpr uint64_t cacheMisses(const uint64_t cache)
+{ return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16); }
+
+const event_t c_events[perfCount] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HW_CACHE, cacheMisses(PERF_COUNT_HW_CACHE_L1D)},
+    {PERF_TYPE_HW_CACHE, cacheMisses(PERF_COUNT_HW_CACHE_LL)},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES}
+};
+
+/*!
+   \brief openEvent opens a counter of the calling thread in user space
+   \param event
+   \param group file descriptor of the leader of the group, -1 to open the leader
+   \return file descriptor, -1 on errors
+ */
+int openEvent(const event_t &event, const int group)
+{
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = event.type;
+    attr.config = event.config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return int(syscall(SYS_perf_event_open, &attr, 0, -1, group, 0));
+}
+#endif
+
+} // namespace
+
+perf_group_t::perf_group_t()
+{
+    m_fds.fill(-1);
+    m_positions.fill(-1);
+}
+
+perf_group_t::~perf_group_t()
+{
+    close();
+}
+
+bool perf_group_t::open()
+{
+    close();
+#ifdef __linux__
+    // the cycles lead the group, so all counters cover the same time
+    int position = 0;
+    for (size_t counter = 0; counter < perfCount; ++counter) {
+        m_fds[counter] = openEvent(c_events[counter], m_fds[perfCycles]);
+        if (m_fds[counter] >= 0) {
+            m_positions[counter] = position++;
+        } else if (counter == perfCycles) {
+            return false;
+        }
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+void perf_group_t::close()
+{
+#ifdef __linux__
+    // the members first, then the leader
+    for (size_t counter = perfCount; counter-- > 0;) {
+        if (m_fds[counter] >= 0) {
+            ::close(m_fds[counter]);
+        }
+    }
+#endif
+    m_fds.fill(-1);
+    m_positions.fill(-1);
+}
+
+bool perf_group_t::read(perf_values_t &values) const
+{
+    values.fill(0);
+    if (!isOpen()) {
+        return false;
+    }
+#ifdef __linux__
+    // number of values, time enabled, time running and the values
+    std::array<uint64_t, 3 + perfCount> data;
+    if (::read(m_fds[perfCycles], data.data(), sizeof(data)) < ssize_t(3*sizeof(uint64_t))) {
+        return false;
+    }
+    const double scale = (data[2] > 0) ? double(data[1])/data[2] : 0;
+    for (size_t counter = 0; counter < perfCount; ++counter) {
+        if (m_positions[counter] >= 0 && uint64_t(m_positions[counter]) < data[0]) {
+            values[counter] = uint64_t(data[3 + m_positions[counter]]*scale);
+        }
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+const char *perf_group_t::name(const perf_counter_t counter)
+{
+    return c_names[counter];
+}
+
+bool perf_team_t::open()
+{
+    #ifdef _OPENMP
+    const size_t size = omp_get_max_threads();
+    #else
+    const size_t size = 1;
+    #endif
+    m_groups.reset(new perf_group_t[size]);
+
+    bool opened = true;
+    #pragma omp parallel reduction(&&:opened)
+    {
+        #ifdef _OPENMP
+        const size_t thread = omp_get_thread_num();
+        #else
+        const size_t thread = 0;
+        #endif
+        if (thread < size) {
+            opened = m_groups[thread].open();
+        }
+    }
+    m_size = opened ? size : 0;
+    if (!opened) {
+        m_groups.reset();
+    }
+    return opened;
+}
+
+perf_values_t perf_team_t::read()
+{
+    std::vector<perf_values_t> values(m_size);
+    #pragma omp parallel
+    {
+        #ifdef _OPENMP
+        const size_t thread = omp_get_thread_num();
+        #else
+        const size_t thread = 0;
+        #endif
+        if (thread < m_size) {
+            m_groups[thread].read(values[thread]);
+        }
+    }
+
+    perf_values_t sum;
+    sum.fill(0);
+    for (const perf_values_t &thread_values: values) {
+        for (size_t counter = 0; counter < perfCount; ++counter) {
+            sum[counter] += thread_values[counter];
+        }
+    }
+    return sum;
+}
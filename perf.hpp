@@ -0,0 +1,146 @@
+/***************************************************************************************
+ * Copyright (c) 2014 Robert Riemann <robert@riemann.cc>                                *
+ *                                                                                      *
+ * This program is free software; you can redistribute it and/or modify it under        *
+ * the terms of the GNU General Public License as published by the Free Software        *
+ * Foundation; either version 2 of the License, or (at your option) any later           *
+ * version.                                                                             *
+ *                                                                                      *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY      *
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A      *
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.             *
+ *                                                                                      *
+ * You should have received a copy of the GNU General Public License along with         *
+ * this program.  If not, see <http://www.gnu.org/licenses/>.                           *
+ ****************************************************************************************/
+/*! \file perf.hpp
+
+    \author Robert Riemann (robert@riemann.cc)
+
+    \brief hardware performance counters of the threads
+
+    The counters are read by the system call perf_event_open of Linux, so no
+    library is needed. Each thread opens its own group of counters, which
+    counts the work of this thread in user space only. On other systems, or
+    if the kernel does not permit the counters (see
+    /proc/sys/kernel/perf_event_paranoid), opening fails and nothing is
+    counted.
+ */
+
+#ifndef PERF_HPP
+#define PERF_HPP
+
+#include <array>
+#include <memory>
+#include <vector>
+#include <cstdint>
+
+#include "settings.h"
+
+/*!
+   \brief enumerates the hardware counters
+ */
+enum perf_counter_t {
+      perfCycles = 0     //!< CPU cycles
+    , perfInstructions   //!< retired instructions
+    , perfL1Misses       //!< read misses of the L1 data cache
+    , perfLLCMisses      //!< read misses of the last level cache
+    , perfBranchMisses   //!< mispredicted branches
+    , perfCount          //!< number of counters
+};
+
+typedef std::array<uint64_t, perfCount> perf_values_t; //!< value per perf_counter_t
+
+/*!
+   \brief The perf_group_t class is a group of counters of the thread which opened it
+ */
+class perf_group_t
+{
+public:
+    perf_group_t();
+    ~perf_group_t();
+
+    /*!
+       \brief open starts counting for the calling thread
+       \return false if not even the cycles can be counted
+     */
+    bool open();
+
+    void close();
+
+    bool isOpen() const
+    { return m_fds[perfCycles] >= 0; }
+
+    /*!
+       \brief read gives the values counted since open()
+
+       Counters the processor does not provide are 0. The values are scaled
+       if the kernel multiplexes the counters.
+
+       \return false if the group is not open or cannot be read
+     */
+    bool read(perf_values_t &values) const;
+
+    //! name of a counter, e.g. for the columns of a table
+    static const char *name(const perf_counter_t counter);
+
+private:
+    perf_group_t(const perf_group_t&) = delete; // the file descriptors are owned
+    perf_group_t &operator=(const perf_group_t&) = delete;
+
+    std::array<int, perfCount> m_fds; //!< file descriptor per counter, -1 if not available
+    std::array<int, perfCount> m_positions; //!< position of each counter in the values of the group, -1 if not available
+};
+
+/*!
+   \brief The perf_team_t class holds a perf_group_t for every OpenMP thread
+
+   open() and read() start parallel regions, so they have to be called
+   outside of them. The groups count as long as the OpenMP threads are kept
+   by the runtime, which is the case unless the number of threads is raised.
+ */
+class perf_team_t
+{
+public:
+    perf_team_t() :
+        m_size(0)
+    {}
+
+    /*!
+       \brief open opens a group in every OpenMP thread
+       \return false if a thread cannot count
+     */
+    bool open();
+
+    bool isOpen() const
+    { return m_size > 0; }
+
+    //! number of groups, one per thread
+    size_t size() const
+    { return m_size; }
+
+    //! the group of a thread, to be read by this thread only
+    perf_group_t &group(const size_t thread)
+    { return m_groups[thread]; }
+
+    /*!
+       \brief read gives the values of all threads added up
+     */
+    perf_values_t read();
+
+private:
+    std::unique_ptr<perf_group_t[]> m_groups;
+    size_t m_size;
+};
+
+//! events between two calls of perf_group_t::read()
+inline perf_values_t perfDifference(const perf_values_t &later, const perf_values_t &earlier)
+{
+    perf_values_t difference;
+    for (size_t counter = 0; counter < perfCount; ++counter) {
+        difference[counter] = later[counter] - earlier[counter];
+    }
+    return difference;
+}
+
+#endif // PERF_HPP
@@ -18,7 +18,6 @@
 #define POINT_HPP
 
 #include <strings.h> // provides the function ffs()
-#include <boost/iterator/iterator_facade.hpp>
 
 #include "settings.h"
 
@@ -73,12 +72,6 @@ public:
         m_phi = phi;
     }
 
-    void setNext(point_t *point)
-    { m_next = point; }
-
-    const point_t *getNext() const
-    { return m_next; }
-
     void setIndex(index_t index)
     { m_index = index; }
 
@@ -106,7 +99,6 @@ public:
     index_t m_index; //!< index with respect to level_max in \ref point_t()
     location_t m_x; //!< point location in physical space
     real m_flow; //!< takes the flow calculated by \ref flowHelper()
-    real m_phi; //!< actual field variable
-    point_t *m_next; //!< part of the forward-only linked list throughout all points in the grid
+    real_field m_phi; //!< actual field variable
 };
 #endif // POINT_HPP
@@ -17,49 +17,212 @@
 #include <string>
 #include <memory>
 #include <fstream>
+#include <sstream>
 #include <iostream>
 #include <algorithm>
 #include <functional>
 #include <chrono>
+#include <vector>
 #include <boost/format.hpp>
 
 // using namespace std;
 
-#ifdef REGULAR
 #include "monores/monores_grid.hpp"
-#else
+#include "linear/linear_grid.hpp"
 #include "point.hpp"
 #include "multires/multires_grid.hpp"
-#endif
 
+#include "config.hpp"
+#include "snapshot.hpp"
 #include "functions.h"
 
-int main()
+/*!
+   \brief createGrid creates the grid of a runner by the configuration
+   \param config
+   \param checkpoint record to restore the grid from, nullptr for a new grid
+ */
+template<typename grid_type>
+grid_type *createGrid(const config_t &config, const snapshot_reader_t *checkpoint)
 {
-    #ifdef _OPENMP
-    const u_char num_procs = omp_get_num_procs(); //!< number of available processors
-    #else
-    const u_char num_procs = 1;
-    #endif
-    std::cerr << "processors in use: " << short(num_procs) << std::endl;
+    if (checkpoint) {
+        return new grid_type(*checkpoint, 0, config.epsilon);
+    }
+    return new grid_type(config.level, 0, config.epsilon, config.fieldGenerator());
+}
 
+template<>
+monores_grid_t *createGrid<monores_grid_t>(const config_t &config, const snapshot_reader_t *checkpoint)
+{
+    if (checkpoint) {
+        return new monores_grid_t(*checkpoint);
+    }
+    return new monores_grid_t(config.level, config.fieldGenerator());
+}
+
+template<>
+multires_grid_t *createGrid<multires_grid_t>(const config_t &config, const snapshot_reader_t *checkpoint)
+{
+    multires_grid_t *grid;
+    if (checkpoint) {
+        grid = new multires_grid_t(*checkpoint, 0, config.epsilon);
+    } else {
+        grid = new multires_grid_t(config.level, 0, config.epsilon, config.fieldGenerator());
+    }
+    config.applyRemesh(*grid);
+    return grid;
+}
 
-    // generation of childrens, e.g.: only root = 0, grand-children = 2
-    // total number of nodes, including (childsbyDimension) boundary elements
+//! refines a multi resolution grid to the finest level for the output
+template<typename grid_type>
+void unfold(grid_type &grid, const size_t level)
+{ grid.unfold(level); }
 
-    real simulationTime = g_span[dimX]/g_velocity*5; // 5 periods
+void unfold(monores_grid_t &, const size_t)
+{}
 
-#ifdef REGULAR
-    monores_grid_t grid(g_level);
-#else
-    multires_grid_t grid(g_level);
-#endif
+//! prints the statistics of the pools of multires_grid_t
+template<typename grid_type>
+void printStatistics(const grid_type &)
+{}
+
+void printStatistics(const multires_grid_t &grid)
+{
+    const auto node_stats  = grid.getNodePool().statistics();
+    const auto point_stats = grid.getPointPool().statistics();
+    std::cerr << boost::format("node pool:  live %d peak %d recycled %d capacity %d in %d slabs\n")
+                 % node_stats.live % node_stats.peak % node_stats.recycled
+                 % node_stats.capacity % node_stats.slabs;
+    std::cerr << boost::format("point pool: live %d peak %d recycled %d capacity %d in %d slabs\n")
+                 % point_stats.live % point_stats.peak % point_stats.recycled
+                 % point_stats.capacity % point_stats.slabs;
+}
+
+/*!
+   \brief writeText writes the points of a grid as text, one point per line
+   \return false if the file could not be written
+ */
+bool writeText(grid_t &grid, const std::string &filename, const u_char num_procs)
+{
+    std::ofstream file(filename);
+    if (!file) {
+        return false;
+    }
+    file << "#";
+    for (u_char dim = 0; dim < g_dimension; ++dim) {
+        file << " " << "xyz"[dim];
+    }
+    file << " phi" << std::endl;
+
+    // the chunks are formatted in parallel and written in order
+    std::vector<grid_t::range_t> chunks(4*num_procs);
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        chunks[i] = grid.chunk(i, chunks.size());
+    }
+    std::vector<std::string> texts(chunks.size());
+    #pragma omp parallel for schedule(dynamic)
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        std::ostringstream text;
+        for (const point_t &point: chunks[i]) {
+            for (u_char dim = 0; dim < g_dimension; ++dim) {
+                text << boost::format("%e ") % point.m_x[dim]; // or point.m_index[dim]
+            }
+            text << boost::format("%e\n") % point.m_phi;
+        }
+        texts[i] = text.str();
+    }
+    for (const std::string &text: texts) {
+        file << text;
+    }
+    file.close();
+    return !file.fail();
+}
+
+/*!
+   \brief run computes on a grid of grid_type and writes the result
+   \return exit code
+
+   The runner is compiled for each grid, so the time steps are not slowed
+   down by the runtime configuration.
+
+   A restarted run continues with the level, the time and the time steps of
+   the checkpoint until the same simulation time. If it writes the snapshots
+   to the file of the checkpoint, the file is continued behind the record.
+ */
+template<typename grid_type>
+int run(const config_t &config, const u_char num_procs)
+{
+    real simulationTime = g_span[dimX]/g_velocity*config.periods;
+
+    std::unique_ptr<snapshot_reader_t> checkpoint;
+    size_t level = config.level;
+    uint64_t offset = 0;
+    if (!config.restart.empty()) {
+        checkpoint.reset(new snapshot_reader_t(config.restart));
+        if (!checkpoint->last() || checkpoint->header().layout != layoutLeaves) {
+            std::cerr << "no checkpoint found in " << config.restart << std::endl;
+            return 1;
+        }
+        level = checkpoint->header().level;
+        offset = (config.snapshots == config.restart) ? checkpoint->offset() : 0;
+        if (config.incremental && config.remesh_tolerance > 0) {
+            std::cerr << "the incremental remesh continues exactly only with remesh_tolerance = 0" << std::endl;
+        }
+        std::cerr << "restarting at step " << checkpoint->header().step
+                  << ", time " << checkpoint->header().time << std::endl;
+    }
+
+    std::unique_ptr<grid_type> grid_ptr(createGrid<grid_type>(config, checkpoint.get()));
+    grid_type &grid = *grid_ptr;
+    checkpoint.reset();
+
+    std::unique_ptr<snapshot_writer_t> snapshots;
+    if (!config.snapshots.empty()) {
+        snapshots.reset(new snapshot_writer_t(config.snapshots, level, config.snapshot_layout, offset));
+        if (!snapshots->flush()) {
+            std::cerr << "cannot write " << config.snapshots << std::endl;
+            return 1;
+        }
+    }
+    const size_t interval = snapshots ? config.snapshot_steps : 0;
+
+    if (config.counters) {
+        if (!instrument_t::c_enabled) {
+            std::cerr << "counters are ignored, the runner has been compiled without INSTRUMENT" << std::endl;
+        } else if (!grid.getInstrument().setCounters(true)) {
+            std::cerr << "hardware counters are not available, see perf_event_open(2)" << std::endl;
+        }
+    }
 
     auto start = std::chrono::steady_clock::now();
 
-    do {
-        grid.timeStep();
-    } while(grid.getTime() < simulationTime);
+    const size_t first = grid.getSteps();
+    if (interval && first == 0 && !snapshots->write(grid)) {
+        std::cerr << "cannot write " << config.snapshots << std::endl;
+        return 1;
+    }
+
+    const real dt = grid.timeStep();
+    size_t steps = 0;
+    for (real time = grid.getTime(); time < simulationTime; time += dt) {
+        ++steps;
+    }
+
+    // the intermediate states between the snapshots are not observed, so the
+    // grid may merge the steps; the snapshots are written in the background,
+    // the one of the last step is written below
+    const size_t last = first + 1 + steps;
+    for (size_t step = first + 1;;) {
+        if (interval && step % interval == 0 && step < last && !snapshots->write(grid)) {
+            std::cerr << "cannot write " << config.snapshots << std::endl;
+            return 1;
+        }
+        if (step == last) {
+            break;
+        }
+        const size_t count = interval ? std::min(last - step, interval - step % interval) : last - step;
+        grid.timeSteps(count);
+        step += count;
+    }
 
     auto done = std::chrono::steady_clock::now();
 
@@ -68,35 +231,75 @@ int main()
     std::cerr << "calculation time: " << elapsed_time << std::endl;
 
     size_t size = grid.size();
-    size_t NN = pow(1 << g_level, g_dimension);
+    size_t NN = pow(1 << level, g_dimension);
     std::cerr << "used nodes: " << size << "/" << NN << "=" << real(size)/NN << std::endl;
 
+    printStatistics(grid);
+
+    if (instrument_t::c_enabled) {
+        grid.getInstrument().summary(std::cerr);
+    }
+
+    if (!config.instrument.empty()) {
+        if (!instrument_t::c_enabled) {
+            std::cerr << "instrument is ignored, the runner has been compiled without INSTRUMENT" << std::endl;
+        } else {
+            std::ofstream file(config.instrument);
+            grid.getInstrument().write(file);
+            if (!file) {
+                std::cerr << "cannot write " << config.instrument << std::endl;
+                return 1;
+            }
+        }
+    }
 
-    // output file
-#ifndef REGULAR
-    grid.unfold(g_level);
-#endif
+    // output files, the snapshots of the leaves are written without unfolding;
+    // the last step has not been written above, so every step has one record
+    const bool leaves = (config.snapshot_layout == layoutLeaves);
+    if (snapshots && leaves && !(snapshots->write(grid) && snapshots->flush())) {
+        std::cerr << "cannot write " << config.snapshots << std::endl;
+        return 1;
+    }
+    if (config.output.empty() && (!snapshots || leaves)) {
+        return 0;
+    }
+    unfold(grid, level);
     std::cerr << "after unfold: size = " << grid.size() << std::endl;
-    std::ofstream file("/tmp/output.txt");
-    file << "# x y phi" << std::endl;
-    for(const point_t point: grid) {
-        // std::cerr << point.m_x[dimX] << " : " << point.m_phi << std::endl;
-        /*
-        */
-        file << boost::format("%e %e %e\n")
-                % point.m_x[dimX]
-                % point.m_x[dimY]
-                // % point.m_index[dimX]
-                // % point.m_index[dimY]
-                % point.m_phi;
-        /*
-        file << boost::format("%e ") % point.m_phi;
-        static size_t count = 0;
-        const size_t N = (1 << g_level);
-        if (++count % N == 0 ) file << std::endl;
-        */
+    if (snapshots && !leaves && !(snapshots->write(grid) && snapshots->flush())) {
+        std::cerr << "cannot write " << config.snapshots << std::endl;
+        return 1;
+    }
+    if (!config.output.empty() && !writeText(grid, config.output, num_procs)) {
+        std::cerr << "cannot write " << config.output << std::endl;
+        return 1;
     }
-    file.close();
 
     return 0;
 }
+
+int main(int argc, char *argv[])
+{
+    config_t config;
+    config.periods = 5;
+    config.output = "/tmp/output.txt";
+    if (!config.parse(argc, argv)) {
+        return 1;
+    }
+    config.apply();
+
+    #ifdef _OPENMP
+    const u_char num_procs = omp_get_num_procs(); //!< number of available processors
+    #else
+    const u_char num_procs = 1;
+    #endif
+    std::cerr << "processors in use: " << short(num_procs) << std::endl;
+
+    switch (config.grid) {
+    case gridRegular:
+        return run<monores_grid_t>(config, num_procs);
+    case gridLinear:
+        return run<linear_grid_t>(config, num_procs);
+    default:
+        return run<multires_grid_t>(config, num_procs);
+    }
+}
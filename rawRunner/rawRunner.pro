@@ -14,11 +14,9 @@ SOURCES += main.cpp
 HEADERS += ../settings.h \
            ../functions.h
 
-contains(DEFINES, REGULAR) {
-    BACKEND_LIB = ../monores/libmonores.a
-} else {
-    BACKEND_LIB = ../multires/libmultires.a
-}
+BACKEND_LIB  = ../multires/libmultires.a
+BACKEND_LIB += ../monores/libmonores.a
+BACKEND_LIB += ../linear/liblinear.a
 
 PRE_TARGETDEPS = $${BACKEND_LIB}
 LIBS          += $${BACKEND_LIB}
@@ -36,18 +36,43 @@
 #include <omp.h>
 #endif
 
-constexpr u_char g_dimension = 2; //!< number of dimensions of the grid
-constexpr short  g_childs = (1 << g_dimension); //!< number of children per node
-#ifdef _OPENMP
-const u_char g_level_fork = log(omp_get_num_procs())/log(g_childs); //!< tree level until we create seperate threads for each child
+#ifndef DIMENSION
+#define DIMENSION 2 //!< number of dimensions, can be set to 1, 2 or 3 by the build
 #endif
 
-typedef double real; //!< determines the accurancy of the computations, e.g. double or float precision
+constexpr u_char g_dimension = DIMENSION; //!< number of dimensions of the grid
+constexpr short  g_childs = (1 << g_dimension); //!< number of children per node
+constexpr short  g_orientations = 2*g_dimension; //!< number of neighbours sharing a face with a node
+
+static_assert(g_dimension >= 1 && g_dimension <= 3, "DIMENSION has to be 1, 2 or 3");
+
+// SINGLE computes in float precision, MIXED only stores the field values in
+// float precision and computes the fluxes and time steps in double precision
+#if defined(SINGLE)
+typedef float  real;       //!< determines the accurancy of the computations, e.g. double or float precision
+typedef float  real_field; //!< determines the accurancy of the stored field values, see point_t::m_phi
+constexpr const char *g_precision = "single"; //!< name of the precision of the build, see config_t::precision
+#elif defined(MIXED)
+typedef double real;
+typedef float  real_field;
+constexpr const char *g_precision = "mixed";
+#else
+typedef double real;
+typedef double real_field;
+constexpr const char *g_precision = "double";
+#endif
 typedef std::array<real, g_dimension> location_t; //!< type to save a point in space
 typedef std::vector<real> real_vector;
+typedef std::vector<real_field> field_vector; //!< field values, see \ref real_field
 typedef std::array<real, g_childs> environment_t; //!< type to keep all children of a node
 typedef std::array<size_t, g_dimension> index_t; //!< type to save a point in space by its indices
 
+/*
+   The constants are the defaults of the runners, see config_t. The parameters
+   of the computation that do not change the types are kept in the runtime
+   globals below and set by config_t::apply() before the grids are created.
+ */
+
 /*!
    \brief cut-off accurancy to drop nodes in the multi resolution tree
 
@@ -71,12 +96,46 @@ const size_t g_level  = 7;
  */
 const real g_eps = std::numeric_limits<real>::epsilon();
 
-const real g_cfl  = 0.1; //!< constant in CFL (Courant, Friedrichs, Lewy) condition
+extern real g_cfl; //!< constant in CFL (Courant, Friedrichs, Lewy) condition, 0.1 by default
+
+/*!
+   \brief uniform gives a location with the same value in all dimensions
+ */
+inline location_t uniform(const real value)
+{
+    location_t x;
+    x.fill(value);
+    return x;
+}
+
+/*!
+   \brief difference gives the vector from a to b
+ */
+inline location_t difference(const location_t &a, const location_t &b)
+{
+    location_t x;
+    for (u_char dim = 0; dim < g_dimension; ++dim) {
+        x[dim] = b[dim] - a[dim];
+    }
+    return x;
+}
+
+extern location_t g_x0;   //!< lower left point of computational domain, 0 by default
+extern location_t g_x1;   //!< upper right point of computational domain, 1 by default
+extern location_t g_span; //!< size of computational domain, difference(g_x0, g_x1)
 
-const location_t g_x0 = {{0, 0}}; //!< lower left point of computational domain
-const location_t g_x1 = {{1, 1}}; //!< upper right point of computational domain
-const location_t g_span = {{g_x1[0] - g_x0[0],
-                            g_x1[1] - g_x0[1]}}; //!< size of computational domain
+/*!
+   \brief cellSize gives the size of the cells of a regular grid in all dimensions
+   \param level of the grid, which has `1 << level` cells per dimension
+ */
+inline location_t cellSize(const size_t level)
+{
+    location_t dx;
+    for (u_char dim = 0; dim < g_dimension; ++dim) {
+        dx[dim] = g_span[dim]/(size_t(1) << level);
+    }
+    return dx;
+}
 
 /*!
    \brief enumerates the dimensions
@@ -88,11 +147,64 @@ enum dimension_t {
 };
 
 /*!
-   \brief defines the interface of a field initializer function to map a \ref location_t type to a \ref real value
+   \brief The field_generator_t class is the interface of a field initializer to map \ref location_t values to \ref real values
+
+   It keeps any callable with the signature `real(location_t)`. If the callable
+   offers a batched version `void(const location_t *x, real *phi, size_t n)` in
+   addition, like the functors of functions.h, a batch of locations costs a
+   single indirect call and the loop over the batch is inlined into the callable.
  */
-typedef std::function<real(location_t)> field_generator_t;
+class field_generator_t
+{
+public:
+    typedef std::function<void(const location_t *, real *, size_t)> batch_t; //!< batched evaluation
+
+    template<typename F>
+    field_generator_t(const F &f) :
+        m_batch(batch(f, 0))
+    {}
+
+    //! field value at one location
+    real operator()(const location_t &x) const
+    {
+        real phi;
+        m_batch(&x, &phi, 1);
+        return phi;
+    }
+
+    //! field values phi at n locations x
+    void operator()(const location_t *x, real *phi, const size_t n) const
+    { m_batch(x, phi, n); }
+
+private:
+    //! the callable has a batched version
+    template<typename F>
+    static auto batch(const F &f, int) -> decltype(f(static_cast<const location_t *>(nullptr),
+                                                     static_cast<real *>(nullptr), size_t(0)), batch_t())
+    { return f; }
+
+    //! the callable evaluates one location
+    template<typename F>
+    static batch_t batch(const F &f, long)
+    {
+        return [f](const location_t *x, real *phi, const size_t n) {
+            for (size_t i = 0; i < n; ++i) {
+                phi[i] = f(x[i]);
+            }
+        };
+    }
+
+    batch_t m_batch;
+};
+
+extern real g_velocity; //!< velocity used in the advection equation solver, 0.5 by default
+
+/*!
+   \brief g_limiter enables the limiting of the derivatives in flowHelper()
 
-const real g_velocity = 0.5; //!< velocity used in the advection equation solver
+   It is set by default if LIMITER is defined.
+ */
+extern bool g_limiter;
 
 /*!
    \brief calculates the flow difference
@@ -107,14 +219,16 @@ const real g_velocity = 0.5; //!< velocity used in the advection equation solver
 
    \sa flowHelper()
  */
-inline real timeStepHelperFlow(const real &flow, const real &flow_left, const real &dx, const real &dt) {
-    return - (dt/dx)*g_velocity*(flow - flow_left);
+template<typename T>
+inline T timeStepHelperFlow(const T &flow, const T &flow_left, const T &dx, const T &dt) {
+    return - (dt/dx)*T(g_velocity)*(flow - flow_left);
 }
 
 /*!
    \brief helper function to implement the minmod limiter
  */
-inline real minmod(const real a, const real b)
+template<typename T>
+inline T minmod(const T a, const T b)
 {
     if (a*b > 0) {
         if (fabs(a) < fabs(b)){
@@ -129,6 +243,7 @@ inline real minmod(const real a, const real b)
 
 /*!
    \brief calculates the flow through the interfaces of the nodes
+   \tparam limiter applies minmod() to the derivative
    \param ee flow of this node
    \param el flow of its previous neighbour
    \param er flow of its next neighbour
@@ -139,21 +254,30 @@ inline real minmod(const real a, const real b)
    With this function the flux at the interfaces is calculated. It is later
    on used to do the actual time step using timeStepHelperFlow()
 
-    LIMITER can be defined to enable the limiting of the derivates and get smoothed
-    behavior close to shocks.
+   The limiting of the derivates gives smoothed behavior close to shocks. The
+   grids choose the limiter once per sweep by \ref g_limiter, so the loops over
+   the cells are compiled for both cases.
 
    \sa timeStepHelperFlow()
  */
-inline real flowHelper(const real &ee, const real &el, const real &er,
-                            const real &dx, const real &dt)
+template<bool limiter, typename T>
+inline T flowHelper(const T &ee, const T &el, const T &er,
+                    const T &dx, const T &dt)
 {
-#ifdef LIMITER
-   const real derivative = minmod(ee - el, er - ee);
-#else
-   const real derivative = (er-el)/2;
-#endif
-   real a_L = ee + 0.5*(1-dt/dx*g_velocity)*derivative;
+   const T derivative = limiter ? minmod(ee - el, er - ee) : (er-el)/2;
+   T a_L = ee + T(0.5)*(1-dt/dx*T(g_velocity))*derivative;
    return a_L;
 }
 
+/*!
+   \brief flowHelper is the same as flowHelper<limiter>() with the limiter given by \ref g_limiter
+ */
+template<typename T>
+inline T flowHelper(const T &ee, const T &el, const T &er,
+                    const T &dx, const T &dt)
+{
+    return g_limiter ? flowHelper<true>(ee, el, er, dx, dt)
+                     : flowHelper<false>(ee, el, er, dx, dt);
+}
+
 #endif // SETTINGS_H
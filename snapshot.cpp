@@ -0,0 +1,369 @@
+/***************************************************************************************
+ * Copyright (c) 2014 Robert Riemann <robert@riemann.cc>                                *
+ *                                                                                      *
+ * This program is free software; you can redistribute it and/or modify it under        *
+ * the terms of the GNU General Public License as published by the Free Software        *
+ * Foundation; either version 2 of the License, or (at your option) any later           *
+ * version.                                                                             *
+ *                                                                                      *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY      *
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A      *
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.             *
+ *                                                                                      *
+ * You should have received a copy of the GNU General Public License along with         *
+ * this program.  If not, see <http://www.gnu.org/licenses/>.                           *
+ ****************************************************************************************/
+
+#include <cstring>
+#include <unistd.h>
+#include <numeric>
+#include <iostream>
+#include <algorithm>
+
+#include "snapshot.hpp"
+#include "grid.hpp"
+
+const uint16_t snapshot_header_t::c_version;
+
+namespace {
+
+//! bytes of the arrays of a record, see snapshot.hpp
+uint64_t arraysSize(const snapshot_header_t &header)
+{
+    if (header.layout == layoutLeaves) {
+        return header.count*(sizeof(morton_t) + header.field_size + sizeof(uint8_t));
+    }
+    return header.count*(header.dimension*header.real_size + header.field_size);
+}
+
+template<typename T>
+void writeArray(std::ofstream &file, const std::vector<T> &values)
+{
+    file.write(reinterpret_cast<const char *>(values.data()), values.size()*sizeof(T));
+}
+
+template<typename T>
+void readArray(std::ifstream &file, std::vector<T> &values, const size_t count)
+{
+    values.resize(count);
+    file.read(reinterpret_cast<char *>(values.data()), count*sizeof(T));
+}
+
+//! cuts an existing file at offset to be continued, a cut off record behind is dropped
+std::ios::openmode openMode(const std::string &filename, const uint64_t offset)
+{
+    if (offset > 0 && truncate(filename.c_str(), offset) == 0) {
+        return std::ios::app;
+    }
+    return std::ios::trunc;
+}
+
+} // namespace
+
+snapshot_writer_t::snapshot_writer_t(const std::string &filename, const u_char level, const snapshot_layout_t layout,
+                                     const uint64_t offset) :
+    m_level(level)
+  , m_layout(layout)
+  , m_file(filename, std::ios::binary | openMode(filename, offset))
+  , m_failed(!m_file)
+  , m_thread(&snapshot_writer_t::run, this)
+{
+}
+
+snapshot_writer_t::~snapshot_writer_t()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_condition.notify_all();
+    m_thread.join();
+}
+
+bool snapshot_writer_t::write(grid_t &grid)
+{
+    buffer_t &buffer = m_buffers[m_next];
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_condition.wait(lock, [&buffer]() { return !buffer.full; });
+        if (m_failed) {
+            return false;
+        }
+    }
+
+    // the buffer is not touched by run() until it is full
+    const grid_t::iterator first = grid.begin();
+    const std::ptrdiff_t count = grid.end() - first;
+    buffer.phi.resize(count);
+    if (m_layout == layoutLeaves) {
+        grid.getCellLevels(buffer.levels);
+        buffer.keys.resize(count);
+        buffer.x.clear();
+    } else {
+        buffer.x.resize(g_dimension*count);
+        buffer.keys.clear();
+        buffer.levels.clear();
+    }
+    #pragma omp parallel for schedule(static)
+    for (std::ptrdiff_t i = 0; i < count; ++i) {
+        const point_t &point = *(first + i);
+        if (m_layout == layoutLeaves) {
+            buffer.keys[i] = morton_encode(point.m_index);
+        } else {
+            for (u_char dim = 0; dim < g_dimension; ++dim) {
+                buffer.x[dim*count + i] = point.m_x[dim];
+            }
+        }
+        buffer.phi[i] = point.m_phi;
+    }
+
+    snapshot_header_t &header = buffer.header;
+    std::memcpy(header.magic, "SNAPSHOT", sizeof(header.magic));
+    header.version    = snapshot_header_t::c_version;
+    header.layout     = m_layout;
+    header.dimension  = g_dimension;
+    header.level      = m_level;
+    header.real_size  = sizeof(real);
+    header.field_size = sizeof(real_field);
+    header.count      = count;
+    header.step       = grid.getSteps();
+    header.time       = grid.getTime();
+    header.size       = (sizeof(header) + arraysSize(header) + 7)/8*8;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        buffer.full = true;
+    }
+    m_condition.notify_all();
+    m_next = 1 - m_next;
+    return true;
+}
+
+bool snapshot_writer_t::flush()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_condition.wait(lock, [this]() { return !m_buffers[0].full && !m_buffers[1].full; });
+    return !m_failed;
+}
+
+void snapshot_writer_t::run()
+{
+    // the buffers are written in the order they are filled
+    u_char current = 0;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        buffer_t &buffer = m_buffers[current];
+        m_condition.wait(lock, [this, &buffer]() { return buffer.full || m_stop; });
+        if (!buffer.full) {
+            break; // stopped and nothing left
+        }
+
+        lock.unlock();
+        if (!m_failed) {
+            writeBuffer(buffer);
+        }
+        lock.lock();
+
+        m_failed = m_failed || !m_file;
+        buffer.full = false;
+        m_condition.notify_all();
+        current = 1 - current;
+    }
+}
+
+void snapshot_writer_t::writeBuffer(buffer_t &buffer)
+{
+    if (m_layout == layoutLeaves && !std::is_sorted(buffer.keys.begin(), buffer.keys.end())) {
+        // the leaves appended by the remeshing of multires_grid_t are out of order
+        std::vector<size_t> order(buffer.keys.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(),
+                  [&buffer](const size_t a, const size_t b) { return buffer.keys[a] < buffer.keys[b]; });
+        std::vector<morton_t> keys(order.size());
+        std::vector<u_char> levels(order.size());
+        std::vector<real_field> phi(order.size());
+        for (size_t i = 0; i < order.size(); ++i) {
+            keys[i]   = buffer.keys[order[i]];
+            levels[i] = buffer.levels[order[i]];
+            phi[i]    = buffer.phi[order[i]];
+        }
+        buffer.keys.swap(keys);
+        buffer.levels.swap(levels);
+        buffer.phi.swap(phi);
+    }
+
+    const snapshot_header_t &header = buffer.header;
+    const char padding[8] = {};
+    m_file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    writeArray(m_file, buffer.x);
+    writeArray(m_file, buffer.keys);
+    writeArray(m_file, buffer.phi);
+    writeArray(m_file, buffer.levels);
+    m_file.write(padding, header.size - sizeof(header) - arraysSize(header));
+    m_file.flush();
+}
+
+snapshot_reader_t::snapshot_reader_t(const std::string &filename) :
+    m_file(filename, std::ios::binary)
+{
+    if (!m_file) {
+        std::cerr << "cannot read " << filename << std::endl;
+    }
+}
+
+bool snapshot_reader_t::next()
+{
+    snapshot_header_t &header = m_header;
+    if (!m_file.read(reinterpret_cast<char *>(&header), sizeof(header))) {
+        return false; // end of file
+    }
+    if (std::memcmp(header.magic, "SNAPSHOT", sizeof(header.magic)) != 0
+            || header.version != snapshot_header_t::c_version
+            || header.layout > layoutLeaves) {
+        std::cerr << "not a snapshot record of version " << snapshot_header_t::c_version << std::endl;
+        return false;
+    }
+    if (header.dimension != g_dimension || header.real_size != sizeof(real)
+            || header.field_size != sizeof(real_field)) {
+        std::cerr << "the snapshot has been written with another DIMENSION or precision" << std::endl;
+        return false;
+    }
+
+    if (header.layout == layoutLeaves) {
+        m_x.clear();
+        readArray(m_file, m_keys, header.count);
+        readArray(m_file, m_phi, header.count);
+        readArray(m_file, m_levels, header.count);
+    } else {
+        readArray(m_file, m_x, g_dimension*header.count);
+        readArray(m_file, m_phi, header.count);
+        m_keys.clear();
+        m_levels.clear();
+    }
+    m_file.ignore(header.size - sizeof(header) - arraysSize(header));
+    if (!m_file) {
+        std::cerr << "truncated snapshot record" << std::endl;
+        return false;
+    }
+    m_offset = m_file.tellg();
+    return true;
+}
+
+bool snapshot_reader_t::last()
+{
+    m_file.clear();
+    m_file.seekg(0, std::ios::end);
+    const uint64_t size = m_file.tellg();
+
+    // skip the records by their headers, the last one may be cut off
+    uint64_t position = 0;
+    uint64_t found = size;
+    snapshot_header_t header;
+    while (position + sizeof(header) <= size) {
+        m_file.seekg(position);
+        if (!m_file.read(reinterpret_cast<char *>(&header), sizeof(header))
+                || std::memcmp(header.magic, "SNAPSHOT", sizeof(header.magic)) != 0
+                || header.size < sizeof(header) || position + header.size > size) {
+            break;
+        }
+        found = position;
+        position += header.size;
+    }
+    if (found == size) {
+        return false;
+    }
+    m_file.clear();
+    m_file.seekg(found);
+    return next();
+}
+
+bool snapshot_reader_t::tree(std::vector<snapshot_node_t> &nodes) const
+{
+    nodes.clear();
+    if (m_header.layout != layoutLeaves || m_keys.empty()) {
+        return false;
+    }
+    nodes.push_back({0, 0, 0, 0});
+    return addChilds(nodes, 0, 0, m_keys.size());
+}
+
+bool snapshot_reader_t::addChilds(std::vector<snapshot_node_t> &nodes, const size_t node,
+                                  const size_t first, const size_t last) const
+{
+    const u_char level = nodes[node].level;
+    if (first == last || m_levels[first] < level) {
+        return false; // the leaves do not tile the node
+    }
+    if (m_levels[first] == level) {
+        nodes[node].phi = m_phi[first];
+        return last - first == 1 && m_keys[first] == nodes[node].key;
+    }
+    if (level >= m_header.level) {
+        return false;
+    }
+
+    const size_t childs = nodes.size();
+    const u_char shift = m_header.level - level - 1;
+    nodes[node].childs = childs;
+    for (u_char pos = 0; pos < g_childs; ++pos) {
+        nodes.push_back({nodes[node].key | (morton_t(pos) << (shift*g_dimension)), u_char(level+1), 0, 0});
+    }
+
+    // the keys are sorted, so the leaves of each child are consecutive
+    size_t begin = first;
+    for (u_char pos = 0; pos < g_childs; ++pos) {
+        const size_t end = (pos+1 < g_childs)
+                ? std::lower_bound(m_keys.begin() + begin, m_keys.begin() + last,
+                                   nodes[childs+pos+1].key) - m_keys.begin()
+                : last;
+        if (!addChilds(nodes, childs+pos, begin, end)) {
+            return false;
+        }
+        begin = end;
+    }
+    nodes[node].phi = nodes[childs].phi;
+    return true;
+}
+
+bool snapshot_reader_t::raster(const u_char level, field_vector &values) const
+{
+    if (m_header.layout != layoutLeaves || level > m_header.level) {
+        return false;
+    }
+
+    const size_t N = size_t(1) << level;
+    size_t NN = 1;
+    for (u_char dim = 0; dim < g_dimension; ++dim) {
+        NN *= N;
+    }
+    values.assign(NN, 0);
+
+    // every cell of the raster is written by exactly one leaf
+    const u_char shift = m_header.level - level;
+    const morton_t corner = ~morton_level_mask(shift);
+    const size_t count = m_keys.size();
+    #pragma omp parallel for schedule(static)
+    for (size_t i = 0; i < count; ++i) {
+        if (m_levels[i] > level && (m_keys[i] & corner)) {
+            continue; // finer leaf inside a cell of the raster
+        }
+        const index_t index = morton_decode(m_keys[i]);
+        const size_t width = (m_levels[i] < level) ? (size_t(1) << (level - m_levels[i])) : 1;
+        size_t cells = 1;
+        for (u_char dim = 0; dim < g_dimension; ++dim) {
+            cells *= width;
+        }
+        for (size_t cell = 0; cell < cells; ++cell) {
+            size_t rest = cell;
+            size_t position = 0;
+            size_t stride = 1;
+            for (u_char dim = 0; dim < g_dimension; ++dim) { // x-direction first
+                position += ((index[dim] >> shift) + rest % width)*stride;
+                rest /= width;
+                stride *= N;
+            }
+            values[position] = m_phi[i];
+        }
+    }
+    return true;
+}
@@ -0,0 +1,263 @@
+/***************************************************************************************
+ * Copyright (c) 2014 Robert Riemann <robert@riemann.cc>                                *
+ *                                                                                      *
+ * This program is free software; you can redistribute it and/or modify it under        *
+ * the terms of the GNU General Public License as published by the Free Software        *
+ * Foundation; either version 2 of the License, or (at your option) any later           *
+ * version.                                                                             *
+ *                                                                                      *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY      *
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A      *
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.             *
+ *                                                                                      *
+ * You should have received a copy of the GNU General Public License along with         *
+ * this program.  If not, see <http://www.gnu.org/licenses/>.                           *
+ ****************************************************************************************/
+/*! \file snapshot.hpp
+
+    \author Robert Riemann (robert@riemann.cc)
+
+    \brief binary snapshots of the grids
+
+    A snapshot file is a sequence of records, one per snapshot. Each record
+    starts with a snapshot_header_t followed by raw little-endian arrays of
+    snapshot_header_t::count values. With \ref layoutPoints these are
+
+    - the coordinates point_t::m_x as \ref real, one array per dimension
+    - the field values point_t::m_phi as \ref real_field
+
+    and with \ref layoutLeaves
+
+    - the Morton keys of the lower left corners of the cells as \ref morton_t,
+      see morton.hpp, in ascending order
+    - the field values as \ref real_field
+    - the levels of the cells as uint8_t
+
+    The records are padded to multiples of 8 bytes, so the arrays of a file
+    mapped into memory are aligned. snapshot_header_t::size gives the offset
+    of the next record.
+
+    A \ref layoutLeaves record holds the complete state of the grids, so it
+    serves as checkpoint too: the grids have constructors which restore them
+    from a snapshot_reader_t and the run continues bit by bit like the one
+    which wrote the record.
+ */
+
+#ifndef SNAPSHOT_HPP
+#define SNAPSHOT_HPP
+
+#include <array>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <fstream>
+#include <cstdint>
+#include <condition_variable>
+
+#include "settings.h"
+#include "morton.hpp"
+
+class grid_t;
+
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "snapshots are written in little-endian byte order");
+
+/*!
+   \brief enumerates the layouts of the records of a snapshot file
+ */
+enum snapshot_layout_t {
+      layoutPoints = 0 //!< coordinates and field values of all points
+    , layoutLeaves     //!< cells of all points, i.e. the leaves of the multi resolution grids
+};
+
+/*!
+   \brief The snapshot_header_t struct starts each record of a snapshot file
+ */
+struct snapshot_header_t {
+    char     magic[8];   //!< "SNAPSHOT"
+    uint16_t version;    //!< version of the file format, \ref c_version
+    uint16_t layout;     //!< see snapshot_layout_t
+    uint8_t  dimension;  //!< see \ref g_dimension
+    uint8_t  level;      //!< finest level of the grid, which the keys refer to
+    uint8_t  real_size;  //!< bytes of a \ref real
+    uint8_t  field_size; //!< bytes of a \ref real_field
+    uint64_t count;      //!< number of points
+    uint64_t step;       //!< number of time steps done
+    double   time;       //!< simulated time, see grid_t::getTime()
+    uint64_t size;       //!< bytes of the record including this header and the padding
+
+    static const uint16_t c_version = 1;
+};
+
+static_assert(sizeof(snapshot_header_t) == 48, "the header must not contain padding");
+
+/*!
+   \brief The snapshot_writer_t class writes snapshots of a grid by a background thread
+
+   write() copies the points of the grid into one of two buffers and returns
+   while the other thread writes the buffer to the file. The time loop is
+   only stalled if it asks for a snapshot before the previous but one is
+   written.
+
+   With \ref layoutLeaves, the snapshots of the multi resolution grids scale
+   with the number of leaves and the grids need not be unfolded. The leaves
+   are sorted by their keys in the background thread.
+ */
+class snapshot_writer_t
+{
+public:
+    /*!
+       \brief snapshot_writer_t opens the file and starts the thread
+       \param filename of the file to be created
+       \param level finest level of the grids, see point_t::m_index
+       \param layout of the records
+       \param offset bytes of an existing file to be kept, e.g. snapshot_reader_t::offset()
+              of the record a run is restarted from, 0 to create a new file
+     */
+    snapshot_writer_t(const std::string &filename, const u_char level, const snapshot_layout_t layout = layoutPoints,
+                      const uint64_t offset = 0);
+
+    //! writes the queued snapshots and closes the file
+    ~snapshot_writer_t();
+
+    /*!
+       \brief write queues a snapshot of a grid
+       \param grid whose points, time and number of time steps are copied
+       \return false if the file could not be written
+     */
+    bool write(grid_t &grid);
+
+    /*!
+       \brief flush waits until the queued snapshots are written
+       \return false if the file could not be written
+     */
+    bool flush();
+
+private:
+    /*!
+       \brief The buffer_t struct keeps a snapshot between copying and writing
+     */
+    struct buffer_t {
+        snapshot_header_t header;
+        std::vector<real>       x;      //!< coordinates, one array per dimension
+        std::vector<morton_t>   keys;   //!< keys of the cells
+        std::vector<u_char>     levels; //!< levels of the cells
+        std::vector<real_field> phi;    //!< field values
+        bool full = false;              //!< queued to be written by run()
+    };
+
+    void run(); //!< loop of the background thread
+
+    /*!
+       \brief writeBuffer writes a full buffer to the file
+     */
+    void writeBuffer(buffer_t &buffer);
+
+    const u_char m_level;
+    const snapshot_layout_t m_layout;
+    std::ofstream m_file;
+    std::array<buffer_t, 2> m_buffers;
+    u_char m_next = 0; //!< buffer to be filled by the next call of write()
+
+    std::mutex m_mutex;
+    std::condition_variable m_condition; //!< signals changes of buffer_t::full and \ref m_stop
+    bool m_stop = false;
+    bool m_failed = false;
+    std::thread m_thread; //!< started last, after the other members are initialised
+};
+
+/*!
+   \brief The snapshot_node_t struct is a node of a tree reconstructed by snapshot_reader_t::tree()
+ */
+struct snapshot_node_t {
+    morton_t   key;    //!< Morton key of the lower left corner on the finest level
+    u_char     level;  //!< level of the node
+    real_field phi;    //!< field value of the leaf, of its first child for inner nodes like in multires_grid_t
+    size_t     childs; //!< index of the first of \ref g_childs consecutive children, 0 for leaves
+};
+
+/*!
+   \brief The snapshot_reader_t class reads the records of a snapshot file one by one
+ */
+class snapshot_reader_t
+{
+public:
+    /*!
+       \brief snapshot_reader_t opens the file, next() reads the first record
+     */
+    explicit snapshot_reader_t(const std::string &filename);
+
+    /*!
+       \brief next reads the next record
+       \return false at the end of the file or if the record cannot be read by this build
+     */
+    bool next();
+
+    /*!
+       \brief last reads the last complete record
+
+       A file cut off while a record is written, e.g. when the run has been
+       killed, still yields the record before.
+
+       \return false if there is no complete record or if it cannot be read by this build
+     */
+    bool last();
+
+    //! position in the file behind the current record
+    uint64_t offset() const
+    { return m_offset; }
+
+    const snapshot_header_t &header() const
+    { return m_header; }
+
+    //! coordinates of \ref layoutPoints, one array per dimension
+    const real_vector &coordinates() const
+    { return m_x; }
+
+    //! keys of \ref layoutLeaves
+    const std::vector<morton_t> &keys() const
+    { return m_keys; }
+
+    //! levels of \ref layoutLeaves
+    const std::vector<u_char> &levels() const
+    { return m_levels; }
+
+    //! field values of both layouts
+    const field_vector &phi() const
+    { return m_phi; }
+
+    /*!
+       \brief tree reconstructs the tree of a \ref layoutLeaves record
+       \param nodes receives the nodes, the root first
+       \return false if the leaves do not tile the domain
+     */
+    bool tree(std::vector<snapshot_node_t> &nodes) const;
+
+    /*!
+       \brief raster samples a \ref layoutLeaves record on a regular grid
+       \param level of the regular grid, at most snapshot_header_t::level
+       \param values receives the value of every cell, x-direction first like monores_grid_t
+
+       Cells of coarser leaves get the value of the leaf, finer leaves are
+       sampled at the lower left corners of the cells.
+
+       \return false if the record cannot be sampled
+     */
+    bool raster(const u_char level, field_vector &values) const;
+
+private:
+    /*!
+       \brief addChilds adds the subtree of nodes[node] covering the leaves first to last-1, see tree()
+     */
+    bool addChilds(std::vector<snapshot_node_t> &nodes, const size_t node, const size_t first, const size_t last) const;
+
+    std::ifstream m_file;
+    snapshot_header_t m_header;
+    uint64_t m_offset = 0;
+    real_vector m_x;
+    std::vector<morton_t> m_keys;
+    std::vector<u_char> m_levels;
+    field_vector m_phi;
+};
+
+#endif // SNAPSHOT_HPP
@@ -46,7 +46,7 @@ public:
      */
     theory_t(const size_t level = g_level, const field_generator_t &f_eval = g_f_eval) :
         N(1 << level)
-      , dx({{g_span[dimX]/N, g_span[dimY]/N}})
+      , dx(cellSize(level))
       , m_f_eval(f_eval)
     {
     }
@@ -58,14 +58,7 @@ public:
        \return field value
      */
     real at(const location_t center, const real time) const {
-        location_t tmp = center;
-        for (u_char dim = 0; dim < g_dimension; ++dim) {
-            real x = fmod(tmp[dim] - time*g_velocity, g_span[dim]);
-            tmp[dim] = fmod(fabs(x - g_x0[dim] + g_span[dim]), g_span[dim]) + g_x0[dim];
-            assert(tmp[dim] >= g_x0[dim] && tmp[dim] <= g_x1[dim]);
-        }
-
-        const real value = m_f_eval(tmp);
+        const real value = m_f_eval(origin(center, time));
         assert(value > -2 && value < 2);
         return value;
     }
@@ -77,11 +70,49 @@ public:
        \return field value
      */
     real at(const index_t &index, const real time) const {
+        return at(center(index), time);
+    }
+
+    /*!
+       \brief at gives the field values at n indices at a given time in one batch
+       \param index array of n indices describing positions in space
+       \param n number of indices
+       \param time at which the solution is calculated
+       \param values receives the n field values
+
+       This is faster than n calls of at(const index_t &, const real) as the
+       field initializer is called once for all points, see field_generator_t.
+     */
+    void at(const index_t *index, const size_t n, const real time, real *values) const {
+        std::vector<location_t> x(n);
+        for (size_t i = 0; i < n; ++i) {
+            x[i] = origin(center(index[i]), time);
+        }
+        m_f_eval(x.data(), values, n);
+        for (size_t i = 0; i < n; ++i) {
+            assert(values[i] > -2 && values[i] < 2);
+        }
+    }
+
+private:
+    //! position in space described by index
+    location_t center(const index_t &index) const {
         location_t center;
         for (u_char dim = 0; dim < g_dimension; ++dim) {
             center[dim] = g_x0[dim]+dx[dim]*index[dim];
         }
-        return at(center, time);
+        return center;
+    }
+
+    //! position in space at time 0 which is advected to center at time
+    location_t origin(const location_t center, const real time) const {
+        location_t tmp = center;
+        for (u_char dim = 0; dim < g_dimension; ++dim) {
+            real x = fmod(tmp[dim] - time*g_velocity, g_span[dim]);
+            tmp[dim] = fmod(fabs(x - g_x0[dim] + g_span[dim]), g_span[dim]) + g_x0[dim];
+            assert(tmp[dim] >= g_x0[dim] && tmp[dim] <= g_x1[dim]);
+        }
+        return tmp;
     }
 
 };